@@ -112,7 +112,9 @@ struct CharAlphabet {
 
   static constexpr CharT Chr(uint64_t x) { return static_cast<char>(x); }
 
-  static constexpr uint64_t Ord(CharT chr) { return chr; }
+  static constexpr uint64_t Ord(CharT chr) {
+    return static_cast<unsigned char>(chr);
+  }
 };
 
 struct AnyAlphabet {
@@ -0,0 +1,127 @@
+#ifndef REGEX_COMPILED_PATTERN_HPP
+#define REGEX_COMPILED_PATTERN_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <variant>
+
+#include "lazy_dfa.hpp"
+#include "nfa.hpp"
+#include "regex.hpp"
+#include "shift_and.hpp"
+#include "tranforms.hpp"
+
+namespace rgx {
+
+/*
+ * Regex compiled once for matching many strings.
+ *
+ * The constructor picks the fastest matcher the pattern fits: Shift-And over
+ * one or four words, or else a lazy DFA. Matching is const and may run from
+ * several threads at once. The lazy DFA keeps its cache in a Scratch, which
+ * every thread should own and reuse between calls.
+ */
+template <typename Alphabet>
+class CompiledPattern {
+  using CharT = typename Alphabet::CharT;
+  using Engine = std::variant<ShiftAndNFSA<Alphabet>, ShiftAndNFSA<Alphabet, 4>,
+                              FrozenNFSA<Alphabet>>;
+
+ public:
+  static const constexpr size_t kNoMatch = NFSA<Alphabet>::kNoMatch;
+
+  // Per thread matching state. Filled on first use and tied to the pattern
+  // (and its copies) that filled it; any other pattern drops it.
+  class Scratch {
+    friend class CompiledPattern;
+    uint64_t pattern_ = 0;
+    std::optional<LazyDFA<Alphabet>> dfa_;
+  };
+
+ private:
+  static inline std::atomic<uint64_t> next_id_ = 1;
+
+  uint64_t id_;
+  Engine engine_;
+
+  static Engine Compile(const Regex<Alphabet>& regex) {
+    auto nfa = GlushkovNFAFromRegex(regex).Freeze();
+    if (auto bits = ShiftAndNFSA<Alphabet>::FromNFA(nfa)) {
+      return std::move(*bits);
+    }
+    if (auto bits = ShiftAndNFSA<Alphabet, 4>::FromNFA(nfa)) {
+      return std::move(*bits);
+    }
+    return nfa;
+  }
+
+ public:
+  explicit CompiledPattern(const Regex<Alphabet>& regex)
+      : id_(next_id_.fetch_add(1, std::memory_order_relaxed)),
+        engine_(Compile(regex)) {}
+
+  // Empty if `rpn` is malformed.
+  static std::optional<CompiledPattern> FromReversePolishNotation(
+      std::basic_string_view<CharT> rpn) {
+    auto regex = Regex<Alphabet>::ParseReversePolishNotation(rpn);
+    if (!regex) {
+      return std::nullopt;
+    }
+    return CompiledPattern(*regex);
+  }
+
+  // Whether matching goes through a Scratch.
+  bool NeedsScratch() const {
+    return std::holds_alternative<FrozenNFSA<Alphabet>>(engine_);
+  }
+
+  // Bytes taken by the compiled matcher. Scratches aren't counted.
+  size_t MemoryUsage() const {
+    return sizeof(*this) +
+           std::visit(
+               [](const auto& engine) {
+                 return engine.MemoryUsage() - sizeof(engine);
+               },
+               engine_);
+  }
+
+  // Length of the longest prefix of `sv` in the language, or kNoMatch.
+  size_t MaxMatch(std::basic_string_view<CharT> sv, Scratch& scratch) const {
+    if (const auto* bits = std::get_if<ShiftAndNFSA<Alphabet>>(&engine_)) {
+      return bits->MaxMatch(sv);
+    }
+    if (const auto* bits = std::get_if<ShiftAndNFSA<Alphabet, 4>>(&engine_)) {
+      return bits->MaxMatch(sv);
+    }
+    if (scratch.pattern_ != id_) {
+      scratch.dfa_.emplace(std::get<FrozenNFSA<Alphabet>>(engine_));
+      scratch.pattern_ = id_;
+    }
+    return scratch.dfa_->MaxMatch(sv);
+  }
+
+  // Builds a throwaway Scratch when one is needed; prefer the overload above
+  // in loops.
+  size_t MaxMatch(std::basic_string_view<CharT> sv) const {
+    Scratch scratch;
+    return MaxMatch(sv, scratch);
+  }
+
+  // Whether all of `sv` is in the language.
+  bool Matches(std::basic_string_view<CharT> sv, Scratch& scratch) const {
+    return MaxMatch(sv, scratch) == sv.length();
+  }
+
+  bool Matches(std::basic_string_view<CharT> sv) const {
+    Scratch scratch;
+    return Matches(sv, scratch);
+  }
+};
+
+}  // namespace rgx
+
+#endif /* REGEX_COMPILED_PATTERN_HPP */
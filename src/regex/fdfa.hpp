@@ -9,35 +9,55 @@
 #include <iostream>
 #include <iterator>
 #include <map>
-#include <set>
+#include <limits>
+#include <type_traits>
 #include <vector>
 
 namespace rgx {
 
-template <typename Alphabet>
+/*
+ * `NodeT` is the type of state ids. Narrower ids make the transition table
+ * proportionally smaller; the automaton may have at most kErrorState states.
+ */
+template <typename Alphabet, typename NodeT = std::size_t>
 class FDFA {
-  using Node = std::size_t;
+  static_assert(std::is_unsigned_v<NodeT>, "State ids must be unsigned");
+
+ public:
+  using Node = NodeT;
+
+ private:
   using CharT = typename Alphabet::CharT;
   Node start_state_ = 0;
   std::vector<std::array<Node, Alphabet::kSize>> transitions_;
-  std::set<Node> finite_;
+  std::vector<bool> finite_;
 
  public:
-  static const constexpr Node kErrorState = ~0ul;
+  static const constexpr Node kErrorState = std::numeric_limits<Node>::max();
   static const constexpr uint64_t kEpsilon = 0;
 
   FDFA() {
     transitions_.emplace_back();
     transitions_.back().fill(kErrorState);
+    finite_.push_back(false);
   }
 
   size_t Size() const { return transitions_.size(); }
 
-  void MakeFinite(Node node) { finite_.insert(node); }
+  void MakeFinite(Node node) {
+    assert(node < Size());
+    finite_[node] = true;
+  }
 
-  bool IsFinite(Node node) const { return finite_.find(node) != finite_.end(); }
+  bool IsFinite(Node node) const {
+    assert(node < Size());
+    return finite_[node];
+  }
 
-  void RemoveFinite(Node node) { finite_.erase(node); }
+  void RemoveFinite(Node node) {
+    assert(node < Size());
+    finite_[node] = false;
+  }
 
   Node Start() const { return start_state_; }
 
@@ -64,8 +84,10 @@ class FDFA {
   }
 
   Node CreateNode() {
+    assert(Size() < kErrorState);
     transitions_.emplace_back();
     transitions_.back().fill(kErrorState);
+    finite_.push_back(false);
     return transitions_.size() - 1;
   }
 
@@ -73,16 +95,20 @@ class FDFA {
 
   template <typename OStream>
   OStream& TextDump(OStream& out) const {
-    out << start_state_ << '\n' << '\n';
+    // Ids are widened before streaming: a uint8_t Node would print as a char.
+    size_t start = start_state_;
+    out << start << '\n' << '\n';
 
-    for (Node node : finite_) {
-      out << node << '\n';
+    for (size_t node = 0; node < Size(); ++node) {
+      if (finite_[node]) {
+        out << node << '\n';
+      }
     }
     out << "\n";
 
     for (size_t node = 0; node < Size(); ++node) {
       for (uint64_t c = 1; c < Alphabet::kSize; ++c) {
-        Node to = transitions_[node][c];
+        size_t to = transitions_[node][c];
         CharT chr = Alphabet::Chr(c);
         if (to != kErrorState) {
           out << node << ' ' << to << ' ';
@@ -98,19 +124,11 @@ class FDFA {
     return out;
   }
 
-  void Inverse() {
-    std::set<Node> new_finite = {};
-    for (size_t i = 0; i < Size(); ++i) {
-      if (!IsFinite(i)) {
-        new_finite.insert(i);
-      }
-    }
-    finite_.swap(new_finite);
-  }
+  void Inverse() { finite_.flip(); }
 };
 
-template <typename Alphabet>
-void FDFA<Alphabet>::GraphDump(const char* filename) const {
+template <typename Alphabet, typename NodeT>
+void FDFA<Alphabet, NodeT>::GraphDump(const char* filename) const {
   std::string tmp_name = "/tmp/";
   tmp_name += filename;
   tmp_name += ".dot";
@@ -124,19 +142,22 @@ void FDFA<Alphabet>::GraphDump(const char* filename) const {
             "rankdir=LR;\n"
             "S [style = invis];"
             "node [shape = doublecircle];\n";
-  if (!finite_.empty()) {
-    for (Node node : finite_) {
-      dotout << node << " ";
+  if (std::find(finite_.begin(), finite_.end(), true) != finite_.end()) {
+    for (size_t node = 0; node < Size(); ++node) {
+      if (finite_[node]) {
+        dotout << node << " ";
+      }
     }
 
     dotout << ";\n";
   }
   dotout << "node [shape = circle];\n";
-  dotout << "S -> " << start_state_ << '\n';
+  size_t start = start_state_;
+  dotout << "S -> " << start << '\n';
 
   for (size_t node = 0; node < Size(); ++node) {
     for (uint64_t c = 1; c < Alphabet::kSize; ++c) {
-      Node to = transitions_[node][c];
+      size_t to = transitions_[node][c];
       CharT chr = Alphabet::Chr(c);
       if (to != kErrorState) {
         dotout << node << " -> " << to << "[label=\"";
@@ -0,0 +1,137 @@
+#ifndef REGEX_FDFA_CACHE_HPP
+#define REGEX_FDFA_CACHE_HPP
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "fdfa.hpp"
+#include "fdfa_image.hpp"
+#include "regex.hpp"
+#include "tranforms.hpp"
+
+namespace rgx {
+
+/*
+ * Directory of minimized DFAs built by MDFAFromRegex, so restarted processes
+ * load them instead of minimizing again.
+ *
+ * Files are FDFA images (see fdfa_image.hpp) labelled with the pattern and
+ * named after an FNV-1a hash of the pattern, kPipelineVersion and the image
+ * format, so colliding or stale files read as misses. Files are written
+ * under a temporary name and renamed into place, so processes sharing the
+ * directory never read a half-written file.
+ */
+template <typename Alphabet, typename Node = std::size_t>
+class FDFADiskCache {
+  using CharT = typename Alphabet::CharT;
+
+ public:
+  // Bump whenever MDFAFromRegex may produce a different automaton.
+  static const constexpr uint32_t kPipelineVersion = 1;
+
+ private:
+  std::filesystem::path dir_;
+
+  static uint64_t Fnv1a(uint64_t hash, const void* data, size_t size) {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+      hash = (hash ^ bytes[i]) * 0x100000001b3ul;
+    }
+    return hash;
+  }
+
+  static std::span<const uint8_t> Bytes(std::basic_string_view<CharT> sv) {
+    return {reinterpret_cast<const uint8_t*>(sv.data()),
+            sv.size() * sizeof(CharT)};
+  }
+
+ public:
+  // Creates `dir` if it doesn't exist.
+  explicit FDFADiskCache(std::filesystem::path dir) : dir_(std::move(dir)) {
+    std::filesystem::create_directories(dir_);
+  }
+
+  std::filesystem::path PathFor(std::basic_string_view<CharT> pattern) const {
+    const uint32_t kKey[] = {kPipelineVersion, FDFAImageHeader::kVersion,
+                             Alphabet::kSize, sizeof(CharT), sizeof(Node)};
+    uint64_t hash = Fnv1a(0xcbf29ce484222325ul, kKey, sizeof(kKey));
+    auto bytes = Bytes(pattern);
+    hash = Fnv1a(hash, bytes.data(), bytes.size());
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016" PRIx64 ".fdfa", hash);
+    return dir_ / name;
+  }
+
+  // The cached automaton mapped in place. Empty if the file is missing,
+  // damaged, or was written for another pattern or pipeline version.
+  std::optional<MappedFDFA<Alphabet, Node>> Map(
+      std::basic_string_view<CharT> pattern) const {
+    auto mapped = MappedFDFA<Alphabet, Node>::Open(PathFor(pattern));
+    if (!mapped || !mapped->View().CheckTable() ||
+        !std::ranges::equal(mapped->View().Label(), Bytes(pattern))) {
+      return std::nullopt;
+    }
+    return mapped;
+  }
+
+  std::optional<FDFA<Alphabet, Node>> Load(
+      std::basic_string_view<CharT> pattern) const {
+    auto mapped = Map(pattern);
+    if (!mapped) {
+      return std::nullopt;
+    }
+    return mapped->View().ToFDFA();
+  }
+
+  // Returns whether the file was written. A file already in place is
+  // replaced atomically.
+  bool Store(std::basic_string_view<CharT> pattern,
+             const FDFA<Alphabet, Node>& fdfa) const {
+    std::filesystem::path path = PathFor(pattern);
+    std::filesystem::path tmp = path;
+    tmp += ".tmp" + std::to_string(std::random_device{}());
+    {
+      std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+      WriteFDFAImage(out, fdfa, Bytes(pattern));
+      out.close();
+      if (!out) {
+        std::error_code ignored;
+        std::filesystem::remove(tmp, ignored);
+        return false;
+      }
+    }
+    std::error_code error;
+    std::filesystem::rename(tmp, path, error);
+    if (error) {
+      std::filesystem::remove(tmp, error);
+      return false;
+    }
+    return true;
+  }
+
+  // MDFAFromRegex(Regex(pattern)), loaded from disk when possible. Failing
+  // to store the result isn't an error.
+  FDFA<Alphabet, Node> Get(std::basic_string_view<CharT> pattern) const {
+    if (auto cached = Load(pattern)) {
+      return std::move(*cached);
+    }
+    auto fdfa = MDFAFromRegex<Alphabet, Node>(Regex<Alphabet>(pattern));
+    Store(pattern, fdfa);
+    return fdfa;
+  }
+};
+
+}  // namespace rgx
+
+#endif /* REGEX_FDFA_CACHE_HPP */
@@ -0,0 +1,341 @@
+#ifndef REGEX_FDFA_IMAGE_HPP
+#define REGEX_FDFA_IMAGE_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "fdfa.hpp"
+
+namespace rgx {
+
+/*
+ * Binary image of an FDFA that is used in place, e.g. straight from an
+ * mmap'ed file. All integers are in host byte order.
+ *
+ *   header      FDFAImageHeader
+ *   alphabet    CharT[kSize - 1], Alphabet::Chr(1) ... Chr(kSize - 1)
+ *   label       uint8_t[label_length], opaque to the image
+ *   finite      uint64_t[(states + 63) / 64], accepting states bitmap
+ *   table       Node[states * kSize], row `v` is Transitions(v)
+ *
+ * Every section starts at a multiple of kImageAlignment.
+ */
+struct FDFAImageHeader {
+  static const constexpr uint64_t kMagic = 0x3141464446584752;  // "RGXFDFA1"
+  static const constexpr uint32_t kVersion = 1;
+  static const constexpr uint32_t kByteOrder = 0x01020304;
+
+  uint64_t magic = kMagic;
+  uint32_t version = kVersion;
+  uint32_t byte_order = kByteOrder;
+  uint32_t alphabet_size = 0;
+  uint32_t char_size = 0;
+  uint32_t node_size = 0;
+  uint32_t label_length = 0;
+  uint64_t states = 0;
+  uint64_t start = 0;
+  uint64_t alphabet_offset = 0;
+  uint64_t label_offset = 0;
+  uint64_t finite_offset = 0;
+  uint64_t table_offset = 0;
+  uint64_t image_size = 0;
+};
+static_assert(sizeof(FDFAImageHeader) == 88, "Header must have no padding");
+
+static const constexpr size_t kImageAlignment = 64;
+
+namespace details {
+
+inline uint64_t AlignImageOffset(uint64_t offset) {
+  return (offset + kImageAlignment - 1) / kImageAlignment * kImageAlignment;
+}
+
+// Header of an image with `states` states and a `label_length` byte label.
+// The offsets are unchecked: `states` must be small enough for the table to
+// fit in memory, which FDFAView::FromBytes checks before calling this.
+template <typename Alphabet, typename Node>
+FDFAImageHeader ImageLayout(size_t states, size_t label_length) {
+  FDFAImageHeader header;
+  header.alphabet_size = Alphabet::kSize;
+  header.char_size = sizeof(typename Alphabet::CharT);
+  header.node_size = sizeof(Node);
+  header.label_length = label_length;
+  header.states = states;
+  header.alphabet_offset = AlignImageOffset(sizeof(FDFAImageHeader));
+  header.label_offset = AlignImageOffset(
+      header.alphabet_offset + (Alphabet::kSize - 1) * header.char_size);
+  header.finite_offset = AlignImageOffset(header.label_offset + label_length);
+  header.table_offset = AlignImageOffset(header.finite_offset +
+                                         (states + 63) / 64 * sizeof(uint64_t));
+  header.image_size = header.table_offset + states * Alphabet::kSize *
+                                                sizeof(Node);
+  return header;
+}
+
+}  // namespace details
+
+/*
+ * Read-only FDFA over an image. Opening checks the header and the alphabet,
+ * not the table, so it costs the same for any size; call CheckTable() before
+ * trusting an image from elsewhere. The bytes must outlive the view.
+ */
+template <typename Alphabet, typename NodeT = std::size_t>
+class FDFAView {
+  using CharT = typename Alphabet::CharT;
+
+ public:
+  using Node = NodeT;
+  static const constexpr Node kErrorState = FDFA<Alphabet, Node>::kErrorState;
+  static const constexpr size_t kNoMatch = ~0ul;
+
+ private:
+  const FDFAImageHeader* header_;
+  const uint64_t* finite_;
+  const Node* table_;
+
+  explicit FDFAView(const std::byte* image)
+      : header_(reinterpret_cast<const FDFAImageHeader*>(image)),
+        finite_(reinterpret_cast<const uint64_t*>(image +
+                                                  header_->finite_offset)),
+        table_(reinterpret_cast<const Node*>(image + header_->table_offset)) {}
+
+ public:
+  // Empty unless `image` holds an image written for this Alphabet and Node
+  // on a machine of the same byte order, and starts 8-byte aligned.
+  static std::optional<FDFAView> FromBytes(std::span<const std::byte> image) {
+    if (image.size() < sizeof(FDFAImageHeader) ||
+        reinterpret_cast<uintptr_t>(image.data()) % alignof(uint64_t) != 0) {
+      return std::nullopt;
+    }
+    const auto& header =
+        *reinterpret_cast<const FDFAImageHeader*>(image.data());
+    // Each state takes a table row, so a `states` that fits in the image
+    // also keeps the layout arithmetic from overflowing.
+    if (header.magic != FDFAImageHeader::kMagic ||
+        header.version != FDFAImageHeader::kVersion ||
+        header.byte_order != FDFAImageHeader::kByteOrder ||
+        header.states == 0 || header.start >= header.states ||
+        header.states > kErrorState ||
+        header.states > image.size() / (Alphabet::kSize * sizeof(Node)) ||
+        header.label_length > image.size()) {
+      return std::nullopt;
+    }
+    FDFAImageHeader expected = details::ImageLayout<Alphabet, Node>(
+        header.states, header.label_length);
+    expected.start = header.start;
+    if (std::memcmp(&header, &expected, sizeof(header)) != 0 ||
+        header.label_offset < header.alphabet_offset ||
+        header.finite_offset < header.label_offset ||
+        header.table_offset < header.finite_offset ||
+        header.image_size < header.table_offset ||
+        image.size() < header.image_size) {
+      return std::nullopt;
+    }
+
+    const auto* chars = reinterpret_cast<const CharT*>(
+        image.data() + header.alphabet_offset);
+    for (uint64_t symbol = 1; symbol < Alphabet::kSize; ++symbol) {
+      if (chars[symbol - 1] != Alphabet::Chr(symbol)) {
+        return std::nullopt;
+      }
+    }
+    return FDFAView(image.data());
+  }
+
+  size_t Size() const { return header_->states; }
+
+  Node Start() const { return header_->start; }
+
+  bool IsFinite(Node node) const {
+    assert(node < Size());
+    return (finite_[node / 64] >> (node % 64)) & 1;
+  }
+
+  std::span<const Node, Alphabet::kSize> Transitions(Node from) const {
+    assert(from < Size());
+    return std::span<const Node, Alphabet::kSize>(
+        table_ + from * Alphabet::kSize, Alphabet::kSize);
+  }
+
+  // Whether every transition leads to a state or kErrorState. Linear.
+  bool CheckTable() const {
+    for (size_t cell = 0; cell < Size() * Alphabet::kSize; ++cell) {
+      if (table_[cell] >= Size() && table_[cell] != kErrorState) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::span<const uint8_t> Label() const {
+    return {reinterpret_cast<const uint8_t*>(header_) + header_->label_offset,
+            header_->label_length};
+  }
+
+  size_t MaxMatch(std::basic_string_view<CharT> sv) const {
+    Node state = Start();
+    size_t ans = kNoMatch;
+    for (size_t i = 0;; ++i) {
+      if (IsFinite(state)) ans = i;
+      if (i == sv.length()) return ans;
+      uint64_t symbol = Alphabet::Ord(sv[i]);
+      if (symbol >= Alphabet::kSize) return ans;
+      state = table_[state * Alphabet::kSize + symbol];
+      if (state == kErrorState) return ans;
+    }
+  }
+
+  // Copy into a mutable automaton.
+  FDFA<Alphabet, Node> ToFDFA() const {
+    FDFA<Alphabet, Node> fdfa;
+    for (size_t node = 1; node < Size(); ++node) {
+      fdfa.CreateNode();
+    }
+    fdfa.SetStart(Start());
+    for (size_t node = 0; node < Size(); ++node) {
+      if (IsFinite(node)) {
+        fdfa.MakeFinite(node);
+      }
+      for (uint64_t via = 0; via < Alphabet::kSize; ++via) {
+        fdfa.SetTransition(node, via, Transitions(node)[via]);
+      }
+    }
+    return fdfa;
+  }
+};
+
+// Writes the image of `fdfa`; `label` is stored verbatim.
+template <typename Alphabet, typename Node>
+void WriteFDFAImage(std::ostream& out, const FDFA<Alphabet, Node>& fdfa,
+                    std::span<const uint8_t> label = {}) {
+  using CharT = typename Alphabet::CharT;
+  FDFAImageHeader header =
+      details::ImageLayout<Alphabet, Node>(fdfa.Size(), label.size());
+  header.start = fdfa.Start();
+
+  uint64_t written = 0;
+  auto write = [&](const void* data, size_t size) {
+    out.write(static_cast<const char*>(data), size);
+    written += size;
+  };
+  auto pad_to = [&](uint64_t offset) {
+    static const constexpr char kZeros[kImageAlignment] = {};
+    write(kZeros, offset - written);
+  };
+
+  write(&header, sizeof(header));
+  pad_to(header.alphabet_offset);
+  for (uint64_t symbol = 1; symbol < Alphabet::kSize; ++symbol) {
+    CharT chr = Alphabet::Chr(symbol);
+    write(&chr, sizeof(chr));
+  }
+  pad_to(header.label_offset);
+  write(label.data(), label.size());
+  pad_to(header.finite_offset);
+  std::vector<uint64_t> finite((fdfa.Size() + 63) / 64);
+  for (size_t node = 0; node < fdfa.Size(); ++node) {
+    finite[node / 64] |= uint64_t{fdfa.IsFinite(node)} << (node % 64);
+  }
+  write(finite.data(), finite.size() * sizeof(uint64_t));
+  pad_to(header.table_offset);
+  for (size_t node = 0; node < fdfa.Size(); ++node) {
+    write(fdfa.Transitions(node).data(), Alphabet::kSize * sizeof(Node));
+  }
+}
+
+/*
+ * Read-only mapping of a whole file. Pages are shared with every other
+ * process mapping the same file.
+ */
+class MappedFile {
+  void* data_ = nullptr;
+  size_t size_ = 0;
+
+  MappedFile(void* data, size_t size) : data_(data), size_(size) {}
+
+ public:
+  MappedFile() = default;
+
+  MappedFile(MappedFile&& oth)
+      : data_(std::exchange(oth.data_, nullptr)),
+        size_(std::exchange(oth.size_, 0)) {}
+
+  MappedFile& operator=(MappedFile&& oth) {
+    std::swap(data_, oth.data_);
+    std::swap(size_, oth.size_);
+    return *this;
+  }
+
+  ~MappedFile() {
+    if (data_) {
+      munmap(data_, size_);
+    }
+  }
+
+  // Empty if the file can't be opened or is empty.
+  static std::optional<MappedFile> Open(const std::filesystem::path& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return std::nullopt;
+    }
+    struct stat info;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+      data = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+      return std::nullopt;
+    }
+    return MappedFile(data, info.st_size);
+  }
+
+  std::span<const std::byte> Bytes() const {
+    return {static_cast<const std::byte*>(data_), size_};
+  }
+};
+
+/*
+ * FDFAView that owns the mapping of its image file.
+ */
+template <typename Alphabet, typename Node = std::size_t>
+class MappedFDFA {
+  MappedFile file_;
+  FDFAView<Alphabet, Node> view_;
+
+  MappedFDFA(MappedFile file, FDFAView<Alphabet, Node> view)
+      : file_(std::move(file)), view_(view) {}
+
+ public:
+  static std::optional<MappedFDFA> Open(const std::filesystem::path& path) {
+    auto file = MappedFile::Open(path);
+    if (!file) {
+      return std::nullopt;
+    }
+    auto view = FDFAView<Alphabet, Node>::FromBytes(file->Bytes());
+    if (!view) {
+      return std::nullopt;
+    }
+    return MappedFDFA(std::move(*file), *view);
+  }
+
+  const FDFAView<Alphabet, Node>& View() const { return view_; }
+};
+
+}  // namespace rgx
+
+#endif /* REGEX_FDFA_IMAGE_HPP */
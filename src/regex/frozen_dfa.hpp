@@ -0,0 +1,386 @@
+#ifndef REGEX_FROZEN_DFA_HPP
+#define REGEX_FROZEN_DFA_HPP
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "fdfa.hpp"
+
+namespace rgx {
+
+/*
+ * Read-only DFA used for matching.
+ *
+ * Symbols that no transition tells apart share a class, and the transition
+ * table has one column per class instead of one per symbol. Symbols outside
+ * the alphabet get a class of their own that leads to kDead everywhere.
+ * States that can't reach an accepting state are merged into kDead, whose
+ * row loops to itself.
+ *
+ * A state id is the offset of its row in the table, so a step is a single
+ * load: table_[state + class]. Row 0 is kDead and the accepting rows follow
+ * it, so one comparison against `special_end_` tells whether a state is dead
+ * or accepting and the matching loops only branch on those.
+ *
+ * `StateT` is the type of table cells, so it bounds the number of rows times
+ * the number of classes. Narrower cells make the table proportionally
+ * smaller; Fits() tells whether an automaton can use them.
+ */
+template <typename Alphabet, typename StateT = uint32_t>
+class FrozenFDFA {
+  static_assert(std::is_unsigned_v<StateT>, "State ids must be unsigned");
+  using CharT = typename Alphabet::CharT;
+
+ public:
+  using State = StateT;
+  using Class = uint16_t;
+  static const constexpr State kDead = 0;
+  static const constexpr size_t kNoMatch = ~0ul;
+  // Inputs MaxMatchMany runs side by side.
+  static const constexpr size_t kLanes = 8;
+
+ private:
+  // Index Alphabet::kSize stands for every symbol outside the alphabet.
+  std::array<Class, Alphabet::kSize + 1> classes_ = {};
+  size_t num_classes_ = 1;
+  std::vector<State> table_;  // Size() * num_classes_
+  State start_state_ = kDead;
+  State special_end_ = 1;  // kDead and accepting states are below.
+
+  Class ClassOfSymbol(uint64_t symbol) const {
+    return classes_[std::min<uint64_t>(symbol, Alphabet::kSize)];
+  }
+
+  // Whether `state` is dead or accepting.
+  bool IsSpecial(State state) const { return state < special_end_; }
+
+  // Rows and symbol classes of the table built for an FDFA.
+  struct Layout {
+    std::vector<size_t> nodes;   // FDFA state of each row.
+    std::vector<size_t> row_of;  // Row of each FDFA state, 0 if dropped.
+    std::array<Class, Alphabet::kSize + 1> classes = {};
+    std::vector<uint64_t> representative;  // One symbol of each class.
+
+    // Whether every table index, so every premultiplied id, fits in State.
+    bool Fits() const {
+      return nodes.size() * representative.size() - 1 <=
+             std::numeric_limits<State>::max();
+    }
+  };
+
+  template <typename Node>
+  static Layout MakeLayout(const FDFA<Alphabet, Node>& fdfa);
+
+  // Row that `symbol` leads to from FDFA state `node`.
+  template <typename Node>
+  static size_t Target(const FDFA<Alphabet, Node>& fdfa, const Layout& layout,
+                       size_t node, uint64_t symbol) {
+    if (symbol == Alphabet::kSize) {
+      return 0;
+    }
+    Node to = fdfa.Transitions(node)[symbol];
+    return to == FDFA<Alphabet, Node>::kErrorState ? 0 : layout.row_of[to];
+  }
+
+ public:
+  // Whether every state of `fdfa` gets an id representable by State. Exact:
+  // it lays out the table like the constructor does, without filling it.
+  template <typename Node>
+  static bool Fits(const FDFA<Alphabet, Node>& fdfa) {
+    return MakeLayout(fdfa).Fits();
+  }
+
+  // Throws std::length_error unless Fits(fdfa).
+  template <typename Node>
+  explicit FrozenFDFA(const FDFA<Alphabet, Node>& fdfa);
+
+  size_t Size() const { return table_.size() / num_classes_; }
+
+  size_t NumClasses() const { return num_classes_; }
+
+  State Start() const { return start_state_; }
+
+  bool IsFinite(State state) const {
+    return state != kDead && IsSpecial(state);
+  }
+
+  Class ClassOf(CharT chr) const { return ClassOfSymbol(Alphabet::Ord(chr)); }
+
+  State Next(State from, CharT chr) const {
+    return table_[from + ClassOf(chr)];
+  }
+
+  // State reached from `from` by reading `sv`.
+  State Walk(std::basic_string_view<CharT> sv, State from) const;
+
+  // Length of the longest prefix of `sv` accepted when starting in `from`,
+  // or kNoMatch.
+  size_t MaxMatch(std::basic_string_view<CharT> sv, State from) const;
+
+  // Length of the longest prefix of `sv` in the language, or kNoMatch.
+  size_t MaxMatch(std::basic_string_view<CharT> sv) const {
+    return MaxMatch(sv, start_state_);
+  }
+
+  // Whether all of `sv` is in the language.
+  bool FullMatch(std::basic_string_view<CharT> sv) const {
+    return IsFinite(Walk(sv, start_state_));
+  }
+
+  // Whether some prefix of `sv` is in the language. Stops at the first one.
+  bool AnyMatch(std::basic_string_view<CharT> sv) const;
+
+  // MaxMatch of each of `inputs`, written to the same index of `results`,
+  // which must be at least as long. Steps kLanes inputs in turn, so their
+  // table loads are independent and overlap instead of each waiting for the
+  // one before. A lane that finishes takes the next input.
+  void MaxMatchMany(std::span<const std::basic_string_view<CharT>> inputs,
+                    std::span<size_t> results) const;
+
+  size_t MemoryUsage() const {
+    return sizeof(*this) + table_.size() * sizeof(State);
+  }
+};
+
+template <typename Alphabet, typename StateT>
+template <typename Node>
+auto FrozenFDFA<Alphabet, StateT>::MakeLayout(const FDFA<Alphabet, Node>& fdfa)
+    -> Layout {
+  const Node kErrorState = FDFA<Alphabet, Node>::kErrorState;
+
+  // Keep states that are reachable from the start and can reach acceptance.
+  std::vector<bool> reachable(fdfa.Size(), false);
+  std::vector<size_t> worklist = {fdfa.Start()};
+  reachable[fdfa.Start()] = true;
+  std::vector<std::vector<size_t>> reverse(fdfa.Size());
+  while (!worklist.empty()) {
+    size_t from = worklist.back();
+    worklist.pop_back();
+    for (size_t to : fdfa.Transitions(from)) {
+      if (to == kErrorState) {
+        continue;
+      }
+      reverse[to].push_back(from);
+      if (!reachable[to]) {
+        reachable[to] = true;
+        worklist.push_back(to);
+      }
+    }
+  }
+
+  std::vector<bool> useful(fdfa.Size(), false);
+  for (size_t node = 0; node < fdfa.Size(); ++node) {
+    if (reachable[node] && fdfa.IsFinite(node)) {
+      useful[node] = true;
+      worklist.push_back(node);
+    }
+  }
+  while (!worklist.empty()) {
+    size_t to = worklist.back();
+    worklist.pop_back();
+    for (size_t from : reverse[to]) {
+      if (!useful[from]) {
+        useful[from] = true;
+        worklist.push_back(from);
+      }
+    }
+  }
+
+  // Rows: kDead, accepting states, the rest.
+  Layout layout;
+  layout.row_of.assign(fdfa.Size(), 0);
+  layout.nodes = {kErrorState};
+  for (bool finite : {true, false}) {
+    for (size_t node = 0; node < fdfa.Size(); ++node) {
+      if (useful[node] && fdfa.IsFinite(node) == finite) {
+        layout.row_of[node] = layout.nodes.size();
+        layout.nodes.push_back(node);
+      }
+    }
+  }
+
+  // Split symbols into classes by their target rows, one state at a time.
+  auto& classes = layout.classes;
+  for (size_t i = 1; i < layout.nodes.size(); ++i) {
+    std::map<std::pair<Class, size_t>, Class> split;
+    for (uint64_t symbol = 0; symbol <= Alphabet::kSize; ++symbol) {
+      auto key = std::make_pair(classes[symbol],
+                                Target(fdfa, layout, layout.nodes[i], symbol));
+      classes[symbol] = split.emplace(key, split.size()).first->second;
+    }
+  }
+  for (uint64_t symbol = 0; symbol <= Alphabet::kSize; ++symbol) {
+    if (classes[symbol] == layout.representative.size()) {
+      layout.representative.push_back(symbol);
+    }
+  }
+  return layout;
+}
+
+template <typename Alphabet, typename StateT>
+template <typename Node>
+FrozenFDFA<Alphabet, StateT>::FrozenFDFA(const FDFA<Alphabet, Node>& fdfa) {
+  Layout layout = MakeLayout(fdfa);
+  if (!layout.Fits()) {
+    throw std::length_error("DFA table doesn't fit in its state type");
+  }
+  classes_ = layout.classes;
+  num_classes_ = layout.representative.size();
+
+  const auto& nodes = layout.nodes;
+  table_.assign(nodes.size() * num_classes_, kDead);
+  for (size_t i = 1; i < nodes.size(); ++i) {
+    for (size_t cls = 0; cls < num_classes_; ++cls) {
+      table_[i * num_classes_ + cls] =
+          Target(fdfa, layout, nodes[i], layout.representative[cls]) *
+          num_classes_;
+    }
+    if (fdfa.IsFinite(nodes[i])) {
+      special_end_ = (i + 1) * num_classes_;
+    }
+  }
+  start_state_ = layout.row_of[fdfa.Start()] * num_classes_;
+}
+
+template <typename Alphabet, typename StateT>
+size_t FrozenFDFA<Alphabet, StateT>::MaxMatch(std::basic_string_view<CharT> sv,
+                                              State from) const {
+  State state = from;
+  size_t ans = IsFinite(state) ? 0 : kNoMatch;
+  if (state == kDead) return ans;
+
+  const State* table = table_.data();
+  size_t i = 0;
+  // Four steps at a time, with a single branch while no state is special.
+  for (; i + 4 <= sv.length(); i += 4) {
+    std::array<State, 4> steps;
+    steps[0] = table[state + ClassOf(sv[i])];
+    steps[1] = table[steps[0] + ClassOf(sv[i + 1])];
+    steps[2] = table[steps[1] + ClassOf(sv[i + 2])];
+    steps[3] = table[steps[2] + ClassOf(sv[i + 3])];
+    if (IsSpecial(steps[0]) | IsSpecial(steps[1]) | IsSpecial(steps[2]) |
+        IsSpecial(steps[3])) {
+      for (size_t k = 0; k < 4; ++k) {
+        if (IsSpecial(steps[k])) {
+          if (steps[k] == kDead) return ans;
+          ans = i + k + 1;
+        }
+      }
+    }
+    state = steps[3];
+  }
+  for (; i < sv.length(); ++i) {
+    state = table[state + ClassOf(sv[i])];
+    if (IsSpecial(state)) {
+      if (state == kDead) return ans;
+      ans = i + 1;
+    }
+  }
+  return ans;
+}
+
+template <typename Alphabet, typename StateT>
+auto FrozenFDFA<Alphabet, StateT>::Walk(std::basic_string_view<CharT> sv,
+                                        State from) const -> State {
+  State state = from;
+  const State* table = table_.data();
+  size_t i = 0;
+  for (; i + 4 <= sv.length(); i += 4) {
+    state = table[state + ClassOf(sv[i])];
+    state = table[state + ClassOf(sv[i + 1])];
+    state = table[state + ClassOf(sv[i + 2])];
+    state = table[state + ClassOf(sv[i + 3])];
+    if (state == kDead) return kDead;
+  }
+  for (; i < sv.length(); ++i) {
+    state = table[state + ClassOf(sv[i])];
+  }
+  return state;
+}
+
+template <typename Alphabet, typename StateT>
+bool FrozenFDFA<Alphabet, StateT>::AnyMatch(
+    std::basic_string_view<CharT> sv) const {
+  State state = start_state_;
+  const State* table = table_.data();
+  for (size_t i = 0; !IsSpecial(state); ++i) {
+    if (i == sv.length()) return false;
+    state = table[state + ClassOf(sv[i])];
+  }
+  return state != kDead;
+}
+
+template <typename Alphabet, typename StateT>
+void FrozenFDFA<Alphabet, StateT>::MaxMatchMany(
+    std::span<const std::basic_string_view<CharT>> inputs,
+    std::span<size_t> results) const {
+  assert(results.size() >= inputs.size());
+  struct Lane {
+    const CharT* chr;
+    size_t pos;
+    size_t length;
+    State state;
+    size_t ans;
+    size_t input;
+  };
+  const State* table = table_.data();
+  const size_t empty_ans = IsFinite(start_state_) ? 0 : kNoMatch;
+
+  size_t next = 0;
+  // Puts the next non-empty input into `lane`; empty ones need no steps.
+  auto refill = [&](Lane& lane) {
+    for (; next < inputs.size(); ++next) {
+      // Inputs are usually scattered, fetch the ones a few refills ahead.
+      if (next + kLanes < inputs.size()) {
+        __builtin_prefetch(inputs[next + kLanes].data());
+      }
+      if (inputs[next].empty()) {
+        results[next] = empty_ans;
+        continue;
+      }
+      lane = {inputs[next].data(), 0,         inputs[next].length(),
+              start_state_,        empty_ans, next};
+      ++next;
+      return true;
+    }
+    return false;
+  };
+
+  std::array<Lane, kLanes> lanes;
+  size_t live = 0;  // Lanes [0, live) hold an input.
+  while (live < kLanes && refill(lanes[live])) {
+    ++live;
+  }
+  while (live > 0) {
+    for (size_t i = 0; i < live;) {
+      Lane& lane = lanes[i];
+      lane.state = table[lane.state + ClassOf(lane.chr[lane.pos++])];
+      if (IsSpecial(lane.state) && lane.state != kDead) {
+        lane.ans = lane.pos;
+      }
+      if (lane.state == kDead || lane.pos == lane.length) {
+        results[lane.input] = lane.ans;
+        if (!refill(lane)) {
+          lane = lanes[--live];
+          continue;
+        }
+      }
+      ++i;
+    }
+  }
+}
+
+}  // namespace rgx
+
+#endif /* REGEX_FROZEN_DFA_HPP */
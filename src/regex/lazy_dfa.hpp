@@ -0,0 +1,138 @@
+#ifndef REGEX_LAZY_DFA_HPP
+#define REGEX_LAZY_DFA_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "nfa.hpp"
+#include "subset_table.hpp"
+
+namespace rgx {
+
+struct LazyDFAStats {
+  size_t hits = 0;     // Transitions found in the cache.
+  size_t misses = 0;   // Transitions computed from the NFSA.
+  size_t flushes = 0;  // Times the cache was dropped for exceeding the budget.
+};
+
+/*
+ * DFA over an epsilon-free NFSA that is built while matching. A DFA state is
+ * a set of NFA states; its outgoing transitions are computed on first use
+ * and cached. When the cache grows over `memory_budget` bytes it is dropped
+ * and refilled from the current state.
+ *
+ * Matching mutates the cache, so one LazyDFA must not be shared between
+ * threads.
+ */
+template <typename Alphabet, typename Node = std::size_t>
+class LazyDFA {
+  using CharT = typename Alphabet::CharT;
+
+ public:
+  using State = uint32_t;
+  static const constexpr size_t kDefaultMemoryBudget = 8ul << 20;
+  static const constexpr size_t kNoMatch = NFSA<Alphabet>::kNoMatch;
+
+ private:
+  static const constexpr State kUnknown = ~State{0};
+  static const constexpr State kDead = kUnknown - 1;
+
+  FrozenNFSA<Alphabet, Node> nfa_;
+  size_t memory_budget_;
+  SubsetTable<Node> states_;
+  std::vector<State> transitions_;  // states_.Size() * Alphabet::kSize
+  std::vector<bool> finite_;
+  LazyDFAStats stats_;
+  std::vector<Node> to_;
+
+  State AddState(const std::vector<Node>& subset) {
+    auto [state, added] = states_.Intern(subset);
+    if (added) {
+      transitions_.resize(transitions_.size() + Alphabet::kSize, kUnknown);
+      finite_.push_back(std::any_of(subset.begin(), subset.end(),
+                                    [this](Node node) {
+                                      return nfa_.IsFinite(node);
+                                    }));
+    }
+    return state;
+  }
+
+  State Next(State from, uint64_t via) {
+    if (via >= Alphabet::kSize) {
+      return kDead;
+    }
+
+    State& cached = transitions_[from * Alphabet::kSize + via];
+    if (cached != kUnknown) {
+      ++stats_.hits;
+      return cached;
+    }
+    ++stats_.misses;
+
+    to_.clear();
+    for (Node node : states_[from]) {
+      for (const auto& edge : nfa_.Transitions(node, via)) {
+        to_.push_back(edge.to);
+      }
+    }
+    if (to_.empty()) {
+      cached = kDead;
+      return kDead;
+    }
+    std::sort(to_.begin(), to_.end());
+    to_.erase(std::unique(to_.begin(), to_.end()), to_.end());
+
+    size_t known = states_.Size();
+    State to = AddState(to_);
+    if (states_.Size() != known &&
+        (MemoryUsage() > memory_budget_ || states_.Size() >= kDead)) {
+      Flush();
+      ++stats_.flushes;
+      return AddState(to_);
+    }
+    transitions_[from * Alphabet::kSize + via] = to;
+    return to;
+  }
+
+ public:
+  explicit LazyDFA(FrozenNFSA<Alphabet, Node> nfa,
+                   size_t memory_budget = kDefaultMemoryBudget)
+      : nfa_(std::move(nfa)), memory_budget_(memory_budget) {
+    assert(!nfa_.IsAnyEpsilon());
+  }
+
+  size_t MaxMatch(std::basic_string_view<CharT> sv) {
+    State state = AddState({nfa_.Start()});
+    size_t ans = kNoMatch;
+    for (size_t i = 0;; ++i) {
+      if (finite_[state]) ans = i;
+      if (i == sv.length()) return ans;
+
+      state = Next(state, Alphabet::Ord(sv[i]));
+      if (state == kDead) return ans;
+    }
+  }
+
+  void Flush() {
+    states_.Clear();
+    transitions_.clear();
+    finite_.clear();
+  }
+
+  const LazyDFAStats& Stats() const { return stats_; }
+
+  size_t CachedStates() const { return states_.Size(); }
+
+  size_t MemoryUsage() const {
+    return states_.MemoryUsage() + transitions_.size() * sizeof(State) +
+           finite_.size() / 8;
+  }
+};
+
+}  // namespace rgx
+
+#endif /* REGEX_LAZY_DFA_HPP */
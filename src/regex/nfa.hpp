@@ -7,35 +7,51 @@
 #include <cstddef>
 #include <cstdint>
 #include <fstream>
-#include <functional>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <map>
-#include <set>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
 namespace rgx {
 
-template <typename Alphabet>
+template <typename Alphabet, typename NodeT = std::size_t>
+class FrozenNFSA;
+
+/*
+ * `NodeT` is the type of state ids, the automaton may have at most
+ * kErrorState states.
+ */
+template <typename Alphabet, typename NodeT = std::size_t>
 class NFSA {
+  static_assert(std::is_unsigned_v<NodeT>, "State ids must be unsigned");
   using CharT = typename Alphabet::CharT;
 
  public:
-  using Node = std::size_t;
+  using Node = NodeT;
 
  private:
-  std::set<Node> m_finite_;
+  std::vector<bool> m_finite_;
   std::vector<std::map<uint64_t, std::vector<Node>>> m_transitions_;
   Node start_state_ = 0;
   Node m_free_node_ = 1;
-  bool any_epsilon_ = true;
+  bool any_epsilon_ = false;
 
  public:
-  static const constexpr Node kErrorState = ~0ul;
+  static const constexpr Node kErrorState = std::numeric_limits<Node>::max();
   static const constexpr uint64_t kEpsilon =
       0;  // Zero is terminator for strings so it will be good go NFA
   static const constexpr uint64_t kInvalid = ~0ul;
+  static const constexpr size_t kNoMatch = ~0ul;
 
-  NFSA() { m_transitions_.emplace_back(); }
+  NFSA() {
+    m_transitions_.emplace_back();
+    m_finite_.push_back(false);
+  }
 
   void Validate() const {
 #ifndef NDEBUG
@@ -51,13 +67,20 @@ class NFSA {
 
   size_t Size() const { return m_free_node_; }
 
-  void MakeFinite(Node node) { m_finite_.insert(node); }
+  void MakeFinite(Node node) {
+    assert(node < Size());
+    m_finite_[node] = true;
+  }
 
   bool IsFinite(Node node) const {
-    return m_finite_.find(node) != m_finite_.end();
+    assert(node < Size());
+    return m_finite_[node];
   }
 
-  void RemoveFinite(Node node) { m_finite_.erase(node); }
+  void RemoveFinite(Node node) {
+    assert(node < Size());
+    m_finite_[node] = false;
+  }
 
   Node Start() const { return Node{start_state_}; }
 
@@ -111,35 +134,59 @@ class NFSA {
   void Kleene();
   void Optional();
 
+  // Walks the builder storage directly. To match many inputs against the
+  // same automaton, Freeze() it once and match on the FrozenNFSA instead.
   size_t MaxMatch(std::basic_string_view<CharT> sv) const;
 
+  // Compressed copy for read-only algorithms. Cheap to query, can't be edited.
+  FrozenNFSA<Alphabet, NodeT> Freeze() const {
+    return FrozenNFSA<Alphabet, NodeT>(*this);
+  }
+
   bool IsAnyEpsilon() const { return any_epsilon_; }
 
+  // Throws std::length_error if all ids below kErrorState are taken.
   Node CreateNode() {
+    if (m_free_node_ == kErrorState) {
+      throw std::length_error("NFA has too many states for its id type");
+    }
     m_transitions_.emplace_back();
+    m_finite_.push_back(false);
     return Node{m_free_node_++};
   }
 
+  // Makes room for `size` states without reallocating.
+  void Reserve(size_t size) {
+    m_transitions_.reserve(size);
+    m_finite_.reserve(size);
+  }
+
   NFSA& RemoveEpsilonTransitions();
 
-  void OptimizeUnreachable();
-  void OptimizeUnreachableTerm();
+  // Drops states that are unreachable from the start or can't reach an
+  // accepting state, and renumbers the rest in their original order. The
+  // start state is always kept. Linear in the size of the automaton.
+  NFSA& Trim();
 
   void GraphDump(const char* filename) const;
 
   template <typename OStream>
   OStream& TextDump(OStream& out) const {
-    out << start_state_ << '\n' << '\n';
+    // Ids are widened before streaming: a uint8_t Node would print as a char.
+    size_t start = start_state_;
+    out << start << '\n' << '\n';
 
-    for (Node node : m_finite_) {
-      out << node << '\n';
+    for (size_t node = 0; node < Size(); ++node) {
+      if (m_finite_[node]) {
+        out << node << '\n';
+      }
     }
     out << "\n";
 
     for (size_t node = 0; node < Size(); ++node) {
       for (auto& [c, trans] : m_transitions_[node]) {
         CharT chr = Alphabet::Chr(c);
-        for (const Node& to : trans) {
+        for (size_t to : trans) {
           out << node << ' ' << to << ' ';
           if (c != kEpsilon) {
             if (Alphabet::NeedEscape(chr)) {
@@ -155,8 +202,101 @@ class NFSA {
   }
 };
 
-template <typename Alphabet>
-void NFSA<Alphabet>::Concat(NFSA<Alphabet> oth) {
+/*
+ * Compressed sparse row form of NFSA. Edges of state `v` are
+ * edges_[offsets_[v], offsets_[v + 1]) sorted by (symbol, target), so
+ * epsilon edges (symbol 0) always come first.
+ */
+template <typename Alphabet, typename NodeT>
+class FrozenNFSA {
+  using CharT = typename Alphabet::CharT;
+
+ public:
+  using Node = NodeT;
+
+  struct Edge {
+    uint64_t symbol;
+    Node to;
+
+    auto operator<=>(const Edge&) const = default;
+  };
+
+ private:
+  std::vector<size_t> offsets_;
+  std::vector<Edge> edges_;
+  std::vector<bool> finite_;
+  Node start_state_ = 0;
+  bool any_epsilon_ = false;
+
+ public:
+  static const constexpr uint64_t kEpsilon = NFSA<Alphabet, NodeT>::kEpsilon;
+  static const constexpr size_t kNoMatch = NFSA<Alphabet, NodeT>::kNoMatch;
+
+  explicit FrozenNFSA(const NFSA<Alphabet, NodeT>& nfa)
+      : offsets_(nfa.Size() + 1, 0),
+        finite_(nfa.Size(), false),
+        start_state_(nfa.Start()) {
+    for (size_t node = 0; node < nfa.Size(); ++node) {
+      for (const auto& [chr, trans] : nfa.Transitions(node)) {
+        offsets_[node + 1] += trans.size();
+      }
+      finite_[node] = nfa.IsFinite(node);
+    }
+    for (size_t node = 0; node < nfa.Size(); ++node) {
+      offsets_[node + 1] += offsets_[node];
+    }
+
+    edges_.reserve(offsets_.back());
+    for (size_t node = 0; node < nfa.Size(); ++node) {
+      for (const auto& [chr, trans] : nfa.Transitions(node)) {
+        for (Node to : trans) {
+          edges_.push_back({chr, to});
+          any_epsilon_ |= chr == kEpsilon;
+        }
+      }
+      // Keys come out of the map ordered, targets of one key don't.
+      std::sort(edges_.begin() + offsets_[node], edges_.end());
+    }
+  }
+
+  size_t Size() const { return offsets_.size() - 1; }
+
+  size_t EdgesCount() const { return edges_.size(); }
+
+  Node Start() const { return start_state_; }
+
+  bool IsFinite(Node node) const { return finite_[node]; }
+
+  bool IsAnyEpsilon() const { return any_epsilon_; }
+
+  std::span<const Edge> Transitions(Node from) const {
+    assert(from < Size());
+    return {edges_.data() + offsets_[from], edges_.data() + offsets_[from + 1]};
+  }
+
+  std::span<const Edge> Transitions(Node from, uint64_t via) const {
+    std::span<const Edge> all = Transitions(from);
+    auto [first, last] =
+        std::equal_range(all.begin(), all.end(), Edge{via, 0},
+                         [](const Edge& lhs, const Edge& rhs) {
+                           return lhs.symbol < rhs.symbol;
+                         });
+    return {first, last};
+  }
+
+  size_t MaxMatch(std::basic_string_view<CharT> sv) const;
+
+  size_t MemoryUsage() const {
+    return sizeof(*this) + offsets_.size() * sizeof(size_t) +
+           edges_.size() * sizeof(Edge) + finite_.size() / 8;
+  }
+};
+
+template <typename Alphabet, typename NodeT>
+void NFSA<Alphabet, NodeT>::Concat(NFSA oth) {
+  if (oth.Size() > kErrorState - Size()) {
+    throw std::length_error("NFA has too many states for its id type");
+  }
   any_epsilon_ = true;
   Validate();
   oth.Validate();
@@ -177,20 +317,24 @@ void NFSA<Alphabet>::Concat(NFSA<Alphabet> oth) {
 
   m_free_node_ += oth.Size();
 
-  for (Node node : m_finite_) {
-    AddTransition(node, kEpsilon, Node{oth.start_state_});
+  for (size_t node = 0; node < delta; ++node) {
+    if (m_finite_[node]) {
+      AddTransition(node, kEpsilon, Node{oth.start_state_});
+    }
   }
 
-  m_finite_.clear();
-
-  for (Node node : oth.m_finite_) {
-    m_finite_.insert(node + delta);
-  }
+  m_finite_.assign(delta, false);
+  m_finite_.insert(m_finite_.end(), oth.m_finite_.begin(),
+                   oth.m_finite_.end());
   Validate();
 }
 
-template <typename Alphabet>
-void NFSA<Alphabet>::Alternate(NFSA<Alphabet> oth) {
+template <typename Alphabet, typename NodeT>
+void NFSA<Alphabet, NodeT>::Alternate(NFSA oth) {
+  // Two more states for the new start and end.
+  if (oth.Size() + 2 > kErrorState - Size()) {
+    throw std::length_error("NFA has too many states for its id type");
+  }
   any_epsilon_ = true;
   Validate();
   oth.Validate();
@@ -209,6 +353,8 @@ void NFSA<Alphabet>::Alternate(NFSA<Alphabet> oth) {
                         std::make_move_iterator(oth.m_transitions_.begin()),
                         std::make_move_iterator(oth.m_transitions_.end()));
 
+  m_finite_.insert(m_finite_.end(), oth.m_finite_.begin(),
+                   oth.m_finite_.end());
   m_free_node_ += oth.Size();
 
   Node new_start = CreateNode();
@@ -218,29 +364,28 @@ void NFSA<Alphabet>::Alternate(NFSA<Alphabet> oth) {
 
   Node new_term = CreateNode();
 
-  for (Node node : m_finite_) {
-    AddTransition(node, kEpsilon, new_term);
-  }
-
-  m_finite_.clear();
-
-  for (Node node : oth.m_finite_) {
-    AddTransition(node + delta, kEpsilon, new_term);
+  for (size_t node = 0; node < new_start; ++node) {
+    if (m_finite_[node]) {
+      AddTransition(node, kEpsilon, new_term);
+    }
   }
 
+  m_finite_.assign(Size(), false);
   MakeFinite(new_term);
   Validate();
 }
 
-template <typename Alphabet>
-void NFSA<Alphabet>::Kleene() {
+template <typename Alphabet, typename NodeT>
+void NFSA<Alphabet, NodeT>::Kleene() {
   any_epsilon_ = true;
   Node new_start = CreateNode();
 
   AddTransition(new_start, kEpsilon, Start());
 
-  for (Node node : m_finite_) {
-    AddTransition(node, kEpsilon, new_start);
+  for (size_t node = 0; node < new_start; ++node) {
+    if (m_finite_[node]) {
+      AddTransition(node, kEpsilon, new_start);
+    }
   }
 
   start_state_ = new_start;
@@ -248,8 +393,8 @@ void NFSA<Alphabet>::Kleene() {
   Validate();
 }
 
-template <typename Alphabet>
-void NFSA<Alphabet>::Optional() {
+template <typename Alphabet, typename NodeT>
+void NFSA<Alphabet, NodeT>::Optional() {
   any_epsilon_ = true;
   Node new_start = CreateNode();
 
@@ -260,8 +405,8 @@ void NFSA<Alphabet>::Optional() {
   Validate();
 }
 
-template <typename Alphabet>
-void NFSA<Alphabet>::GraphDump(const char* filename) const {
+template <typename Alphabet, typename NodeT>
+void NFSA<Alphabet, NodeT>::GraphDump(const char* filename) const {
   std::string tmp_name = "/tmp/";
   tmp_name += filename;
   tmp_name += ".dot";
@@ -275,20 +420,23 @@ void NFSA<Alphabet>::GraphDump(const char* filename) const {
             "rankdir=LR;\n"
             "S [style = invis];"
             "node [shape = doublecircle];\n";
-  if (!m_finite_.empty()) {
-    for (Node node : m_finite_) {
-      dotout << node << " ";
+  if (std::find(m_finite_.begin(), m_finite_.end(), true) != m_finite_.end()) {
+    for (size_t node = 0; node < Size(); ++node) {
+      if (m_finite_[node]) {
+        dotout << node << " ";
+      }
     }
 
     dotout << ";\n";
   }
   dotout << "node [shape = circle];\n";
-  dotout << "S -> " << start_state_ << '\n';
+  size_t start = start_state_;
+  dotout << "S -> " << start << '\n';
 
   for (size_t node = 0; node < Size(); ++node) {
     for (auto& [c, trans] : m_transitions_[node]) {
       CharT chr = Alphabet::Chr(c);
-      for (const Node& to : trans) {
+      for (size_t to : trans) {
         dotout << node << " -> " << to << "[label=\"";
         if (c != kEpsilon) {
           if (Alphabet::NeedEscape(chr)) {
@@ -310,150 +458,287 @@ void NFSA<Alphabet>::GraphDump(const char* filename) const {
   std::system(command.c_str());
 }
 
-template <typename Alphabet>
-NFSA<Alphabet>& NFSA<Alphabet>::RemoveEpsilonTransitions() {
+template <typename Alphabet, typename NodeT>
+NFSA<Alphabet, NodeT>& NFSA<Alphabet, NodeT>::RemoveEpsilonTransitions() {
   if (!any_epsilon_) return *this;
-  std::vector<Node> worklist;
-  std::set<Node> reachable;
-  for (size_t node = 0; node < Size(); ++node) {
-    reachable.clear();
-    worklist.push_back(node);
-
-    while (!worklist.empty()) {
-      Node via = worklist.back();
-      worklist.pop_back();
-
-      if (reachable.find(via) != reachable.end()) {
+  const FrozenNFSA<Alphabet, NodeT> frozen = Freeze();
+  using Edge = typename FrozenNFSA<Alphabet, NodeT>::Edge;
+  const size_t kNone = ~0ul;
+
+  // Strongly connected components of epsilon edges (Tarjan). They are
+  // numbered in reverse topological order: epsilon edges only lead to the
+  // same component or to one with a smaller id.
+  std::vector<size_t> index(Size(), kNone);
+  std::vector<size_t> low(Size());
+  std::vector<size_t> component(Size(), kNone);
+  std::vector<Node> stack;
+  std::vector<std::pair<Node, size_t>> calls;  // Node, next epsilon edge.
+  size_t visited = 0;
+  size_t components = 0;
+  for (size_t root = 0; root < Size(); ++root) {
+    if (index[root] != kNone) {
+      continue;
+    }
+    index[root] = low[root] = visited++;
+    stack.push_back(root);
+    calls.emplace_back(root, 0);
+    while (!calls.empty()) {
+      auto [node, next] = calls.back();
+      auto epsilon = frozen.Transitions(node, kEpsilon);
+      if (next < epsilon.size()) {
+        ++calls.back().second;
+        Node to = epsilon[next].to;
+        if (index[to] == kNone) {
+          index[to] = low[to] = visited++;
+          stack.push_back(to);
+          calls.emplace_back(to, 0);
+        } else if (component[to] == kNone) {
+          low[node] = std::min(low[node], index[to]);
+        }
         continue;
       }
 
-      reachable.insert(via);
-
-      if (m_transitions_[via].find(kEpsilon) != m_transitions_[via].end()) {
-        for (Node to : m_transitions_[via].at(kEpsilon)) {
-          worklist.push_back(to);
-        }
+      calls.pop_back();
+      if (!calls.empty()) {
+        Node parent = calls.back().first;
+        low[parent] = std::min(low[parent], low[node]);
+      }
+      if (low[node] == index[node]) {
+        Node member;
+        do {
+          member = stack.back();
+          stack.pop_back();
+          component[member] = components;
+        } while (member != node);
+        ++components;
       }
     }
+  }
 
-    reachable.erase(node);
+  // Members of every component, grouped by component id.
+  std::vector<size_t> first(components + 1, 0);
+  for (size_t node = 0; node < Size(); ++node) {
+    ++first[component[node] + 1];
+  }
+  for (size_t id = 0; id < components; ++id) {
+    first[id + 1] += first[id];
+  }
+  std::vector<Node> members(Size());
+  {
+    std::vector<size_t> fill(first.begin(), first.end() - 1);
+    for (size_t node = 0; node < Size(); ++node) {
+      members[fill[component[node]]++] = node;
+    }
+  }
 
-    for (Node via : reachable) {
-      if (m_finite_.find(via) != m_finite_.end()) {
-        m_finite_.insert(node);
+  // Closure of a component: its own non-epsilon edges and the closures of
+  // the components its epsilon edges lead to, deduplicated.
+  std::vector<std::vector<Edge>> closure(components);
+  std::vector<bool> closure_finite(components, false);
+  std::vector<size_t> merged(components, kNone);
+  for (size_t id = 0; id < components; ++id) {
+    std::vector<Edge>& edges = closure[id];
+    for (size_t i = first[id]; i < first[id + 1]; ++i) {
+      Node member = members[i];
+      if (frozen.IsFinite(member)) {
+        closure_finite[id] = true;
       }
-
-      for (auto& [chr, trans] : m_transitions_[via]) {
-        if (chr == kEpsilon) {
-          continue;
-        }
-        for (const Node& tp : trans) {
-          AddTransition(node, chr, tp);
+      for (const Edge& edge : frozen.Transitions(member)) {
+        size_t to = component[edge.to];
+        if (edge.symbol != kEpsilon) {
+          edges.push_back(edge);
+        } else if (to != id && merged[to] != id) {
+          merged[to] = id;
+          edges.insert(edges.end(), closure[to].begin(), closure[to].end());
+          if (closure_finite[to]) {
+            closure_finite[id] = true;
+          }
         }
       }
     }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+  }
 
-    m_transitions_[node].erase(kEpsilon);
+  for (size_t node = 0; node < Size(); ++node) {
+    m_transitions_[node].clear();
+    for (const Edge& edge : closure[component[node]]) {
+      m_transitions_[node][edge.symbol].push_back(edge.to);
+    }
+    if (closure_finite[component[node]]) {
+      m_finite_[node] = true;
+    }
   }
-  OptimizeUnreachable();
-  Validate();
-  any_epsilon_ = false;
+  Trim();
   return *this;
 }
 
-template <typename Alphabet>
-void NFSA<Alphabet>::OptimizeUnreachable() {
+template <typename Alphabet, typename NodeT>
+NFSA<Alphabet, NodeT>& NFSA<Alphabet, NodeT>::Trim() {
+  // Forward search from the start.
   std::vector<bool> reachable(Size(), false);
-  std::vector<Node> worklist;
-  worklist.push_back(start_state_);
-
+  std::vector<Node> worklist = {start_state_};
+  reachable[start_state_] = true;
+  std::vector<size_t> reverse_offsets(Size() + 1, 0);
   while (!worklist.empty()) {
     Node node = worklist.back();
     worklist.pop_back();
-
-    if (reachable[node]) {
-      continue;
+    for (const auto& [chr, trans] : m_transitions_[node]) {
+      for (Node to : trans) {
+        ++reverse_offsets[to + 1];
+        if (!reachable[to]) {
+          reachable[to] = true;
+          worklist.push_back(to);
+        }
+      }
     }
+  }
 
-    reachable[node] = true;
-
-    for (auto& [chr, trans] : m_transitions_[node]) {
-      for (const Node& tp : trans) {
-        worklist.push_back(tp);
+  // Backward search from reachable accepting states, over the reversed edges
+  // of reachable states only.
+  for (size_t node = 0; node < Size(); ++node) {
+    reverse_offsets[node + 1] += reverse_offsets[node];
+  }
+  std::vector<Node> reverse(reverse_offsets.back());
+  {
+    std::vector<size_t> fill(reverse_offsets.begin(),
+                             reverse_offsets.end() - 1);
+    for (size_t node = 0; node < Size(); ++node) {
+      if (!reachable[node]) {
+        continue;
+      }
+      for (const auto& [chr, trans] : m_transitions_[node]) {
+        for (Node to : trans) {
+          reverse[fill[to]++] = node;
+        }
       }
     }
   }
-
-  for (size_t i = 0; i < Size(); ++i) {
-    if (!reachable[i]) {
-      m_finite_.erase(i);
-      m_transitions_[i].clear();
+  std::vector<bool> useful(Size(), false);
+  for (size_t node = 0; node < Size(); ++node) {
+    if (reachable[node] && m_finite_[node]) {
+      useful[node] = true;
+      worklist.push_back(node);
     }
   }
-}
-
-template <typename Alphabet>
-void NFSA<Alphabet>::OptimizeUnreachableTerm() {
-  std::vector<bool> reachable_term(Size(), false);
-  std::vector<bool> visited(Size(), false);
-
-  std::function<void(Node)> check_reachable_term;
-  check_reachable_term = [&, this](Node node) {
-    if (reachable_term[node]) {
-      return;
+  while (!worklist.empty()) {
+    Node to = worklist.back();
+    worklist.pop_back();
+    for (size_t i = reverse_offsets[to]; i < reverse_offsets[to + 1]; ++i) {
+      if (!useful[reverse[i]]) {
+        useful[reverse[i]] = true;
+        worklist.push_back(reverse[i]);
+      }
     }
-    visited[node] = true;
-    if (IsFinite(node)) {
-      reachable_term[node] = true;
-      return;
+  }
+  useful[start_state_] = true;
+
+  // Survivors keep their relative order.
+  std::vector<Node> new_id(Size(), kErrorState);
+  size_t kept = 0;
+  for (size_t node = 0; node < Size(); ++node) {
+    if (useful[node]) {
+      new_id[node] = kept++;
     }
+  }
 
-    for (auto& [key, tos] : m_transitions_[node]) {
-      for (auto& to : tos) {
-        if (!visited[to]) {
-          check_reachable_term(to);
-        }
-        if (reachable_term[to]) {
-          reachable_term[node] = true;
-          return;
-        }
+  any_epsilon_ = false;
+  for (size_t node = 0; node < Size(); ++node) {
+    if (!useful[node]) {
+      continue;
+    }
+    auto& transitions = m_transitions_[node];
+    for (auto it = transitions.begin(); it != transitions.end();) {
+      auto& trans = it->second;
+      std::erase_if(trans, [&](Node to) { return !useful[to]; });
+      for (Node& to : trans) {
+        to = new_id[to];
+      }
+      if (trans.empty()) {
+        it = transitions.erase(it);
+        continue;
       }
+      any_epsilon_ |= it->first == kEpsilon;
+      ++it;
     }
-  };
-
-  for (size_t i = 0; i < Size(); ++i) {
-    visited.assign(Size(), false);
-    check_reachable_term(i);
-  }
-  for (size_t i = 0; i < Size(); ++i) {
-    for (auto& [key, tos] : m_transitions_[i]) {
-      std::erase_if(tos, [&](Node node) { return !reachable_term[node]; });
+    if (new_id[node] != node) {
+      m_transitions_[new_id[node]] = std::move(transitions);
+      m_finite_[new_id[node]] = m_finite_[node];
     }
   }
+  m_transitions_.resize(kept);
+  m_finite_.resize(kept);
+  m_free_node_ = kept;
+  start_state_ = new_id[start_state_];
+  Validate();
+  return *this;
 }
 
-template <typename Alphabet>
-size_t NFSA<Alphabet>::MaxMatch(std::basic_string_view<CharT> sv) const {
-  assert(!any_epsilon_);
-  std::set<Node> state{start_state_};
-  size_t ans = ~0ul;
-  for (size_t i = 0; i < sv.length(); ++i) {
+namespace details {
+/*
+ * Subset simulation shared by NFSA and FrozenNFSA, which only differ in how
+ * they look up transitions: targets(from, symbol, fn) calls fn(to) for
+ * every edge. Returns the length of the longest accepted prefix of `sv`, or
+ * kNoMatch.
+ */
+template <typename Alphabet, typename Node, typename IsFinite,
+          typename Targets>
+size_t SubsetMaxMatch(std::basic_string_view<typename Alphabet::CharT> sv,
+                      Node start, size_t size, IsFinite is_finite,
+                      Targets targets) {
+  const size_t kNoMatch = NFSA<Alphabet, Node>::kNoMatch;
+  std::vector<Node> state{start};
+  std::vector<Node> trans;
+  std::vector<size_t> added(size, kNoMatch);
+  size_t ans = kNoMatch;
+  for (size_t i = 0;; ++i) {
+    if (std::any_of(state.begin(), state.end(), is_finite)) {
+      ans = i;
+    }
+    if (i == sv.length()) return ans;
+
     uint64_t via = Alphabet::Ord(sv[i]);
-    std::set<Node> trans;
+    trans.clear();
     for (auto from : state) {
-      if (IsFinite(from)) ans = i;
-
-      if (m_transitions_[from].find(via) != m_transitions_[from].end()) {
-        for (auto to : m_transitions_[from].at(via)) {
-          trans.insert(to);
+      targets(from, via, [&](Node to) {
+        if (added[to] != i) {
+          added[to] = i;
+          trans.push_back(to);
         }
-      }
+      });
     }
 
     if (trans.empty()) return ans;
     state.swap(trans);
   }
-  return ans;
+}
+}  // namespace details
+
+template <typename Alphabet, typename NodeT>
+size_t NFSA<Alphabet, NodeT>::MaxMatch(
+    std::basic_string_view<CharT> sv) const {
+  assert(!any_epsilon_);
+  return details::SubsetMaxMatch<Alphabet>(
+      sv, start_state_, Size(), [this](Node node) { return IsFinite(node); },
+      [this](Node from, uint64_t via, auto fn) {
+        auto it = m_transitions_[from].find(via);
+        if (it != m_transitions_[from].end()) {
+          std::for_each(it->second.begin(), it->second.end(), fn);
+        }
+      });
+}
+
+template <typename Alphabet, typename NodeT>
+size_t FrozenNFSA<Alphabet, NodeT>::MaxMatch(
+    std::basic_string_view<CharT> sv) const {
+  assert(!any_epsilon_);
+  return details::SubsetMaxMatch<Alphabet>(
+      sv, start_state_, Size(), [this](Node node) { return IsFinite(node); },
+      [this](Node from, uint64_t via, auto fn) {
+        for (const Edge& edge : Transitions(from, via)) {
+          fn(edge.to);
+        }
+      });
 }
 
 }  // namespace rgx
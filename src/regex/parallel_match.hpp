@@ -0,0 +1,197 @@
+#ifndef REGEX_PARALLEL_MATCH_HPP
+#define REGEX_PARALLEL_MATCH_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "frozen_dfa.hpp"
+#include "thread_pool.hpp"
+
+namespace rgx {
+
+namespace details {
+
+/*
+ * Where a chunk of input leads every state of a FrozenFDFA.
+ *
+ * The chunk is run from all states at once. Runs that reach the same state
+ * are merged, first after every byte and then less and less often, and runs
+ * that die are dropped, since kDead loops to itself. Once at most one run is
+ * left (usually after a few bytes) the rest of the chunk costs as much as a
+ * single run.
+ */
+template <typename Alphabet, typename StateT>
+class ChunkMap {
+  using CharT = typename Alphabet::CharT;
+  using DFA = FrozenFDFA<Alphabet, StateT>;
+  using State = typename DFA::State;
+
+  static const constexpr size_t kMaxMergeInterval = 64;
+  static const constexpr uint32_t kDeadRun = ~0u;
+
+  size_t stride_ = 1;
+  std::vector<uint32_t> run_of_row_;  // kDeadRun for rows that lead to kDead.
+  std::vector<State> runs_;           // Current state of every live run.
+
+  // Drops dead runs and runs in the same state as an earlier one.
+  void Merge(std::vector<uint32_t>& run_at_row) {
+    std::vector<uint32_t> merged(runs_.size());
+    size_t kept = 0;
+    for (size_t run = 0; run < runs_.size(); ++run) {
+      uint32_t& at = run_at_row[runs_[run] / stride_];
+      if (runs_[run] == DFA::kDead) {
+        merged[run] = kDeadRun;
+        continue;
+      }
+      if (at == kDeadRun) {
+        at = kept;
+        runs_[kept++] = runs_[run];
+      }
+      merged[run] = at;
+    }
+    runs_.resize(kept);
+    for (State state : runs_) {
+      run_at_row[state / stride_] = kDeadRun;
+    }
+    for (uint32_t& run : run_of_row_) {
+      if (run != kDeadRun) {
+        run = merged[run];
+      }
+    }
+  }
+
+ public:
+  ChunkMap() = default;
+
+  ChunkMap(const DFA& dfa, std::basic_string_view<CharT> chunk)
+      : stride_(dfa.NumClasses()), run_of_row_(dfa.Size(), kDeadRun) {
+    // Row 0 is kDead and needs no run.
+    for (size_t row = 1; row < dfa.Size(); ++row) {
+      run_of_row_[row] = runs_.size();
+      runs_.push_back(row * stride_);
+    }
+    std::vector<uint32_t> run_at_row(dfa.Size(), kDeadRun);
+    size_t i = 0;
+    for (size_t interval = 1; runs_.size() > 1 && i < chunk.length();
+         interval = std::min(2 * interval, kMaxMergeInterval)) {
+      for (size_t end = std::min(chunk.length(), i + interval); i < end; ++i) {
+        for (State& state : runs_) {
+          state = dfa.Next(state, chunk[i]);
+        }
+      }
+      Merge(run_at_row);
+    }
+    if (runs_.size() == 1) {
+      runs_[0] = dfa.Walk(chunk.substr(i), runs_[0]);
+    }
+  }
+
+  State From(State state) const {
+    uint32_t run = run_of_row_[state / stride_];
+    return run == kDeadRun ? DFA::kDead : runs_[run];
+  }
+};
+
+// Splits `sv` into chunks for `pool`. Returns the chunk starts followed by
+// sv.length(); a single chunk means the input isn't worth splitting.
+inline std::vector<size_t> ChunkBounds(size_t length, const ThreadPool& pool) {
+  static const constexpr size_t kMinChunk = 1ul << 16;
+  // A few chunks per thread for the stealing to even out.
+  static const constexpr size_t kChunksPerThread = 4;
+
+  size_t chunks = std::min(pool.Size() * kChunksPerThread, length / kMinChunk);
+  chunks = std::max<size_t>(chunks, 1);
+  std::vector<size_t> bounds(chunks + 1);
+  for (size_t chunk = 0; chunk <= chunks; ++chunk) {
+    bounds[chunk] = length * chunk / chunks;
+  }
+  return bounds;
+}
+
+// State of `dfa` at the start of every chunk, followed by the final one.
+template <typename Alphabet, typename StateT>
+std::vector<StateT> ChunkEntries(
+    const FrozenFDFA<Alphabet, StateT>& dfa,
+    std::basic_string_view<typename Alphabet::CharT> sv,
+    const std::vector<size_t>& bounds, ThreadPool& pool) {
+  size_t chunks = bounds.size() - 1;
+  auto chunk = [&](size_t index) {
+    return sv.substr(bounds[index], bounds[index + 1] - bounds[index]);
+  };
+
+  // The first chunk starts in a known state and is run just from it.
+  StateT first = dfa.Start();
+  std::vector<ChunkMap<Alphabet, StateT>> maps(chunks);
+  pool.ParallelFor(chunks, [&](size_t index) {
+    if (index == 0) {
+      first = dfa.Walk(chunk(0), dfa.Start());
+    } else {
+      maps[index] = ChunkMap<Alphabet, StateT>(dfa, chunk(index));
+    }
+  });
+
+  std::vector<StateT> entries = {dfa.Start(), first};
+  for (size_t index = 1; index < chunks; ++index) {
+    entries.push_back(maps[index].From(entries.back()));
+  }
+  return entries;
+}
+
+}  // namespace details
+
+/*
+ * FrozenFDFA::FullMatch and MaxMatch of one long input, split across the
+ * threads of `pool`.
+ *
+ * The input is cut into chunks, and each chunk is mapped from every state at
+ * once (see details::ChunkMap). Composing the maps left to right gives the
+ * state every chunk really starts in. MaxMatch then runs each chunk once
+ * more from that state to find its last accepting position. Inputs too short
+ * to split run on the calling thread.
+ */
+template <typename Alphabet, typename StateT>
+bool ParallelFullMatch(const FrozenFDFA<Alphabet, StateT>& dfa,
+                       std::basic_string_view<typename Alphabet::CharT> sv,
+                       ThreadPool& pool) {
+  auto bounds = details::ChunkBounds(sv.length(), pool);
+  if (bounds.size() == 2) {
+    return dfa.FullMatch(sv);
+  }
+  return dfa.IsFinite(details::ChunkEntries(dfa, sv, bounds, pool).back());
+}
+
+template <typename Alphabet, typename StateT>
+size_t ParallelMaxMatch(const FrozenFDFA<Alphabet, StateT>& dfa,
+                        std::basic_string_view<typename Alphabet::CharT> sv,
+                        ThreadPool& pool) {
+  const size_t kNoMatch = FrozenFDFA<Alphabet, StateT>::kNoMatch;
+  auto bounds = details::ChunkBounds(sv.length(), pool);
+  if (bounds.size() == 2) {
+    return dfa.MaxMatch(sv);
+  }
+  auto entries = details::ChunkEntries(dfa, sv, bounds, pool);
+
+  size_t chunks = bounds.size() - 1;
+  std::vector<size_t> last(chunks, kNoMatch);
+  pool.ParallelFor(chunks, [&](size_t index) {
+    // Dead is absorbing, nothing after it matches.
+    if (entries[index] != FrozenFDFA<Alphabet, StateT>::kDead) {
+      last[index] = dfa.MaxMatch(
+          sv.substr(bounds[index], bounds[index + 1] - bounds[index]),
+          entries[index]);
+    }
+  });
+  for (size_t index = chunks; index-- > 0;) {
+    if (last[index] != kNoMatch) {
+      return bounds[index] + last[index];
+    }
+  }
+  return kNoMatch;
+}
+
+}  // namespace rgx
+
+#endif /* REGEX_PARALLEL_MATCH_HPP */
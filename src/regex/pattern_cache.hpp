@@ -0,0 +1,184 @@
+#ifndef REGEX_PATTERN_CACHE_HPP
+#define REGEX_PATTERN_CACHE_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include "compiled_pattern.hpp"
+#include "regex.hpp"
+
+namespace rgx {
+
+enum class Notation : uint8_t {
+  Infix,
+  Polish,
+  ReversePolish,
+};
+
+struct PatternCacheStats {
+  size_t hits = 0;
+  size_t misses = 0;     // Includes malformed patterns.
+  size_t evictions = 0;  // Entries dropped for exceeding the budget.
+};
+
+/*
+ * Thread-safe LRU cache of compiled patterns keyed by pattern text and
+ * notation; the alphabet is fixed by the type. Entries are shared and
+ * immutable, so one stays usable after it is evicted.
+ *
+ * The budget bounds the summed CompiledPattern::MemoryUsage() of cached
+ * entries. A pattern bigger than the whole budget is compiled and returned
+ * but not kept. Compilation runs outside the lock.
+ */
+template <typename Alphabet>
+class PatternCache {
+  using CharT = typename Alphabet::CharT;
+  using String = std::basic_string<CharT>;
+
+ public:
+  using Pattern = CompiledPattern<Alphabet>;
+  static const constexpr size_t kDefaultMemoryBudget = 64ul << 20;
+
+ private:
+  struct Key {
+    String text;
+    Notation notation;
+
+    bool operator==(const Key&) const = default;
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return std::hash<String>{}(key.text) * 31 +
+             static_cast<size_t>(key.notation);
+    }
+  };
+
+  struct Entry {
+    Key key;
+    std::shared_ptr<const Pattern> pattern;
+    size_t size;
+  };
+
+  size_t memory_budget_;
+  mutable std::mutex mutex_;
+  std::list<Entry> entries_;  // Most recently used first.
+  std::unordered_map<Key, typename std::list<Entry>::iterator, KeyHash> index_;
+  size_t memory_usage_ = 0;
+  PatternCacheStats stats_;
+
+  // nullopt if the text is malformed. An empty Regex is a valid pattern, it
+  // stands for the empty language.
+  static std::optional<Regex<Alphabet>> Parse(const Key& key) {
+    switch (key.notation) {
+      case Notation::Infix:
+        try {
+          return Regex<Alphabet>(key.text);
+        } catch (const std::runtime_error&) {
+          return std::nullopt;
+        }
+      case Notation::Polish:
+        return Regex<Alphabet>::ParsePolishNotation(key.text);
+      case Notation::ReversePolish:
+        return Regex<Alphabet>::ParseReversePolishNotation(key.text);
+      default:
+        assert(0 && "Bad notation");
+        abort();
+    }
+  }
+
+  static std::shared_ptr<const Pattern> Compile(const Key& key) {
+    auto regex = Parse(key);
+    if (!regex) {
+      return nullptr;
+    }
+    return std::make_shared<const Pattern>(*regex);
+  }
+
+  void EvictOverBudget() {
+    while (memory_usage_ > memory_budget_) {
+      memory_usage_ -= entries_.back().size;
+      index_.erase(entries_.back().key);
+      entries_.pop_back();
+      ++stats_.evictions;
+    }
+  }
+
+ public:
+  explicit PatternCache(size_t memory_budget = kDefaultMemoryBudget)
+      : memory_budget_(memory_budget) {}
+
+  // Returns nullptr if `text` is malformed.
+  std::shared_ptr<const Pattern> Get(std::basic_string_view<CharT> text,
+                                     Notation notation = Notation::Infix) {
+    Key key{String(text), notation};
+    {
+      std::lock_guard lock(mutex_);
+      if (auto it = index_.find(key); it != index_.end()) {
+        entries_.splice(entries_.begin(), entries_, it->second);
+        ++stats_.hits;
+        return it->second->pattern;
+      }
+      ++stats_.misses;
+    }
+
+    std::shared_ptr<const Pattern> pattern = Compile(key);
+    if (!pattern) {
+      return nullptr;
+    }
+    size_t size = pattern->MemoryUsage() + key.text.size() * sizeof(CharT);
+    if (size > memory_budget_) {
+      return pattern;
+    }
+
+    std::lock_guard lock(mutex_);
+    if (auto it = index_.find(key); it != index_.end()) {
+      // Compiled by another thread meanwhile.
+      entries_.splice(entries_.begin(), entries_, it->second);
+      return it->second->pattern;
+    }
+    entries_.push_front({key, pattern, size});
+    index_.emplace(std::move(key), entries_.begin());
+    memory_usage_ += size;
+    EvictOverBudget();
+    return pattern;
+  }
+
+  void Clear() {
+    std::lock_guard lock(mutex_);
+    entries_.clear();
+    index_.clear();
+    memory_usage_ = 0;
+  }
+
+  size_t Size() const {
+    std::lock_guard lock(mutex_);
+    return entries_.size();
+  }
+
+  size_t MemoryUsage() const {
+    std::lock_guard lock(mutex_);
+    return memory_usage_;
+  }
+
+  PatternCacheStats Stats() const {
+    std::lock_guard lock(mutex_);
+    return stats_;
+  }
+};
+
+}  // namespace rgx
+
+#endif /* REGEX_PATTERN_CACHE_HPP */
@@ -2,10 +2,16 @@
 #define REGEX_REGEX_HPP
 
 #include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
-#include "../casting.hpp"
 #include "tokenizer.hpp"
 
 /*
@@ -22,11 +28,22 @@ namespace rgx {
 template <typename Alphabet>
 class Regex;
 
+/*
+ * Syntax tree of a regex stored in one arena. Nodes live in `nodes_` and are
+ * addressed by 32-bit ids; children of a node are the slice
+ * children_[begin, end). A tree is a few allocations no matter how many
+ * nodes it has, and copying or freeing it is flat.
+ *
+ * Nodes are hash-consed, so equal subtrees are stored once and the tree is
+ * really a DAG. Nodes are never changed after they are added; edits build
+ * new nodes on top of the old ones.
+ */
 template <typename Alphabet>
 class RegexImpl {
  public:
   using CharT = Alphabet::CharT;
-  enum RegexKind {
+  using Id = uint32_t;
+  enum RegexKind : uint8_t {
     RK_Letter = 0,
     RK_Empty,
     RK_Kleene,
@@ -35,414 +52,714 @@ class RegexImpl {
     RK_Alternate,
   };
 
- protected:
-  explicit RegexImpl(RegexKind kind) : kind_(kind) {}
+  static const constexpr Id kNoNode = ~Id{0};
 
- public:
-  // Non copyable
-  RegexImpl(const RegexImpl&) = delete;
-  RegexImpl& operator=(const RegexImpl&) = delete;
+  struct Node {
+    RegexKind kind;
+    uint32_t letter;  // Only for RK_Letter.
+    Id begin;
+    Id end;
+    uint64_t hash;  // Structural, the same for equal trees in any arena.
+  };
 
  private:
-  const RegexKind kind_;
-
- public:
-  RegexKind GetKind() const { return kind_; }
-
-  virtual ~RegexImpl() { assert(kind_ <= RK_Alternate); };
-
-  static RegexImpl* FromString(std::basic_string_view<CharT> str) {
-    Tokenizer<Alphabet> tokenizer{str};
-    TokenIterator<Alphabet> it = tokenizer.begin();
-    RegexImpl* rgx = FromString(it);
-
-    if (rgx && it != tokenizer.end()) {
-      delete rgx;
-      return nullptr;
-    }
+  friend class Regex<Alphabet>;
+  static const constexpr size_t kMinSlots = 16;
+
+  std::vector<Node> nodes_;
+  std::vector<Id> children_;
+  std::vector<Id> slots_ = std::vector<Id>(kMinSlots, kNoNode);
+  Id root_ = kNoNode;
+
+  // Root list that Regex::Concat or Regex::Alternate is appending to, between
+  // Open() and Close(). Its children are children_[open_begin_, open_end_)
+  // with room up to open_room_, so an append rarely copies them; open_hash_
+  // is its hash before the number of children is mixed in. Close() keeps
+  // these for the root it interns (`spare_root_`), so a chain of appends to
+  // the same root reuses the room and takes amortized O(1) per append.
+  bool is_open_ = false;
+  RegexKind open_kind_ = RK_Concatenate;
+  Id open_begin_ = 0;
+  Id open_end_ = 0;
+  Id open_room_ = 0;
+  uint64_t open_hash_ = 0;
+  Id spare_root_ = kNoNode;
+
+  class Parser;
+  class PolishReader;
+
+  RegexImpl() = default;
+  RegexImpl(const RegexImpl&) = default;
+  RegexImpl& operator=(const RegexImpl&) = delete;
 
-    return rgx;
+  static uint64_t Mix(uint64_t hash, uint64_t value) {
+    hash = (hash ^ value) * 0x9e3779b97f4a7c15ul;
+    return hash ^ (hash >> 29);
   }
 
-  virtual RegexImpl* Copy() const {
-    assert(false && "Copying bare regex");
-    return nullptr;
+  void Grow() {
+    slots_.assign(slots_.size() * 2, kNoNode);
+    size_t mask = slots_.size() - 1;
+    for (Id id = 0; id < nodes_.size(); ++id) {
+      size_t slot = nodes_[id].hash & mask;
+      while (slots_[slot] != kNoNode) {
+        slot = (slot + 1) & mask;
+      }
+      slots_[slot] = id;
+    }
   }
 
-  virtual void Reverse() {}
-
- protected:
-  static RegexImpl* FromString(TokenIterator<Alphabet>& it);
-};
-
-template <typename Alphabet>
-class RegexLetter : public RegexImpl<Alphabet> {
-  friend class Regex<Alphabet>;
-  uint64_t m_letter_;
-  explicit RegexLetter(uint64_t letter)
-      : RegexImpl<Alphabet>(RegexImpl<Alphabet>::RK_Letter),
-        m_letter_(letter) {}
-
- public:
-  Alphabet::CharT GetLetterChr() const { return Alphabet::Chr(m_letter_); }
-
-  ~RegexLetter() override = default;
-
-  static bool Classof(const RegexImpl<Alphabet>* regex) {
-    return !regex || regex->GetKind() == RegexImpl<Alphabet>::RK_Letter;
+  // The number of children is mixed in last, so a list can be extended
+  // without rehashing the children it already has.
+  uint64_t PartialHash(RegexKind kind, uint32_t letter,
+                       std::span<const Id> subs) const {
+    uint64_t hash = Mix(kind, letter);
+    for (Id sub : subs) {
+      hash = Mix(hash, nodes_[sub].hash);
+    }
+    return hash;
+  }
+
+  // Slot of the node equal to the given one, or the empty slot to put it in.
+  size_t Find(uint64_t hash, RegexKind kind, uint32_t letter,
+              std::span<const Id> subs) const {
+    size_t mask = slots_.size() - 1;
+    size_t slot = hash & mask;
+    for (; slots_[slot] != kNoNode; slot = (slot + 1) & mask) {
+      const Node& node = nodes_[slots_[slot]];
+      if (node.hash == hash && node.kind == kind && node.letter == letter &&
+          std::ranges::equal(GetSubregex(slots_[slot]), subs)) {
+        break;
+      }
+    }
+    return slot;
   }
 
-  static RegexImpl<Alphabet>* FromString(TokenIterator<Alphabet>& it) {
-    if (it->type == RegexToken<Alphabet>::Type::Letter) {
-      auto* ret = new RegexLetter(it->chr);
-      ++it;
-      return ret;
+  // Adds a node whose children are already children_[begin, end).
+  Id AddNode(size_t slot, RegexKind kind, uint32_t letter, Id begin, Id end,
+             uint64_t hash) {
+    assert(nodes_.size() < kNoNode);
+    nodes_.push_back({kind, letter, begin, end, hash});
+    slots_[slot] = nodes_.size() - 1;
+    if (nodes_.size() * 2 > slots_.size()) {
+      Grow();
     }
-    return nullptr;
+    return nodes_.size() - 1;
+  }
+
+  // Nodes are hash-consed: a node equal to an existing one isn't added, the
+  // existing id is returned instead. Since children are consed first, equal
+  // subtrees of one arena always have the same id. `subs` must not point
+  // into children_.
+  Id Intern(RegexKind kind, uint32_t letter, std::span<const Id> subs) {
+    uint64_t hash = Mix(PartialHash(kind, letter, subs), subs.size());
+    size_t slot = Find(hash, kind, letter, subs);
+    if (slots_[slot] != kNoNode) {
+      return slots_[slot];
+    }
+    Id begin = children_.size();
+    children_.insert(children_.end(), subs.begin(), subs.end());
+    return AddNode(slot, kind, letter, begin, children_.size(), hash);
   }
 
-  RegexLetter* Copy() const override { return new RegexLetter(m_letter_); }
-};
+  Id AddLetter(uint64_t letter) {
+    return Intern(RK_Letter, static_cast<uint32_t>(letter), {});
+  }
 
-template <typename Alphabet>
-class RegexEmpty : public RegexImpl<Alphabet> {
-  friend class Regex<Alphabet>;
-  RegexEmpty() : RegexImpl<Alphabet>(RegexImpl<Alphabet>::RK_Empty) {}
+  Id AddEmpty() { return Intern(RK_Empty, 0, {}); }
 
- public:
-  ~RegexEmpty() override = default;
+  Id AddQuantified(Id sub, RegexKind kind) {
+    assert(kind == RK_Kleene || kind == RK_Optional);
+    return Intern(kind, 0, std::span<const Id>(&sub, 1));
+  }
 
-  static bool Classof(const RegexImpl<Alphabet>* regex) {
-    return !regex || regex->GetKind() == RegexImpl<Alphabet>::RK_Empty;
+  Id AddList(RegexKind kind, std::span<const Id> subs) {
+    assert(kind == RK_Concatenate || kind == RK_Alternate);
+    return Intern(kind, 0, subs);
   }
 
-  static RegexImpl<Alphabet>* FromString(TokenIterator<Alphabet>& it) {
-    if (it->type == RegexToken<Alphabet>::Type::Empty) {
-      auto* ret = new RegexEmpty();
-      ++it;
-      return ret;
+  // Undoes the newest Intern() that added a node. Nothing refers to that
+  // node, and no probe sequence of the table passes its slot, since every
+  // other node was placed before it. Its children stay in children_.
+  void PopNode() {
+    Id id = nodes_.size() - 1;
+    size_t mask = slots_.size() - 1;
+    size_t slot = nodes_[id].hash & mask;
+    while (slots_[slot] != id) {
+      slot = (slot + 1) & mask;
+    }
+    slots_[slot] = kNoNode;
+    nodes_.pop_back();
+  }
+
+  // Opens the root as a `kind` list for Append(); Root() is stale until
+  // Close(). A root that already is such a list lends its children, and is
+  // dropped if nothing else was added after it.
+  void Open(RegexKind kind) {
+    assert(!is_open_);
+    is_open_ = true;
+    open_kind_ = kind;
+    if (GetKind(root_) != kind) {
+      open_begin_ = children_.size();
+      children_.push_back(root_);
+      open_end_ = open_room_ = children_.size();
+      open_hash_ = PartialHash(kind, 0, std::span<const Id>(&root_, 1));
+      return;
+    }
+    if (spare_root_ != root_) {
+      open_begin_ = nodes_[root_].begin;
+      open_end_ = open_room_ = nodes_[root_].end;
+      open_hash_ = PartialHash(kind, 0, GetSubregex(root_));
+    }
+    if (root_ + 1 == nodes_.size()) {
+      PopNode();
     }
-    return nullptr;
   }
 
-  RegexEmpty* Copy() const override { return new RegexEmpty; }
-};
-
-template <typename Alphabet>
-class RegexSimple : public RegexImpl<Alphabet> {
-  friend class Regex<Alphabet>;
-
- public:
-  static RegexImpl<Alphabet>* FromString(TokenIterator<Alphabet>& it) {
-    if (it->type == RegexToken<Alphabet>::Type::LBracket) {
-      TokenIterator<Alphabet> backup_it = it;
-      ++it;
-      RegexImpl<Alphabet>* regex = RegexImpl<Alphabet>::FromString(it);
-
-      if (it->type != RegexToken<Alphabet>::Type::RBracket) {
-        delete regex;
-        it = backup_it;
-        return nullptr;
+  void Append(Id sub) {
+    assert(is_open_);
+    if (open_end_ == open_room_) {
+      // Out of room: move the children to the end of children_, unless they
+      // are there already, and double the room.
+      Id size = open_end_ - open_begin_;
+      if (open_room_ != children_.size()) {
+        Id begin = children_.size();
+        children_.resize(begin + size);
+        std::copy(children_.begin() + open_begin_,
+                  children_.begin() + open_end_, children_.begin() + begin);
+        open_begin_ = begin;
+        open_end_ = begin + size;
       }
-
-      ++it;
-      return regex;
+      children_.resize(open_end_ + size + 1, kNoNode);
+      open_room_ = children_.size();
     }
-
-    RegexImpl<Alphabet>* rgx = RegexLetter<Alphabet>::FromString(it);
-    if (!rgx) {
-      rgx = RegexEmpty<Alphabet>::FromString(it);
+    children_[open_end_++] = sub;
+    open_hash_ = Mix(open_hash_, nodes_[sub].hash);
+  }
+
+  void Close() {
+    assert(is_open_);
+    is_open_ = false;
+    std::span<const Id> subs(children_.data() + open_begin_,
+                             children_.data() + open_end_);
+    uint64_t hash = Mix(open_hash_, subs.size());
+    size_t slot = Find(hash, open_kind_, 0, subs);
+    if (slots_[slot] != kNoNode) {
+      root_ = slots_[slot];
+      spare_root_ = kNoNode;
+      return;
+    }
+    root_ = AddNode(slot, open_kind_, 0, open_begin_, open_end_, hash);
+    spare_root_ = root_;
+  }
+
+  // Children always have smaller ids than their parents, so a tree can be
+  // rebuilt bottom-up in one pass over the ids. Returns the new root.
+  template <typename Transform>
+  Id Rebuild(const RegexImpl& from, Transform transform) {
+    std::vector<Id> ids(from.nodes_.size());
+    std::vector<Id> subs;
+    for (Id id = 0; id < from.nodes_.size(); ++id) {
+      const Node& node = from.nodes_[id];
+      subs.clear();
+      for (Id sub : from.GetSubregex(id)) {
+        subs.push_back(ids[sub]);
+      }
+      transform(node.kind, subs);
+      ids[id] = Intern(node.kind, node.letter, subs);
     }
-    return rgx;
+    return ids[from.Root()];
   }
-};
 
-template <typename Alphabet>
-class RegexQuantified : public RegexImpl<Alphabet> {
-  friend class Regex<Alphabet>;
-  RegexImpl<Alphabet>* m_regex_;
-  RegexQuantified(RegexImpl<Alphabet>* regex,
-                  typename RegexImpl<Alphabet>::RegexKind kind)
-      : RegexImpl<Alphabet>(kind), m_regex_(regex) {
-    assert(Classof(this));
+  // Copies the tree of `oth` into this arena and returns its root.
+  Id Import(const RegexImpl& oth) {
+    return Rebuild(oth, [](RegexKind, std::vector<Id>&) {});
+  }
+
+  void Reverse() {
+    assert(!is_open_);
+    RegexImpl reversed;
+    reversed.root_ =
+        reversed.Rebuild(*this, [](RegexKind kind, std::vector<Id>& subs) {
+          if (kind == RK_Concatenate) {
+            std::reverse(subs.begin(), subs.end());
+          }
+        });
+    nodes_.swap(reversed.nodes_);
+    children_.swap(reversed.children_);
+    slots_.swap(reversed.slots_);
+    root_ = reversed.root_;
+    spare_root_ = kNoNode;
   }
 
  public:
-  const RegexImpl<Alphabet>* GetSubregex() const { return m_regex_; }
+  static RegexImpl* FromString(std::basic_string_view<CharT> str);
+
+  // Operators before (Polish) or after (reverse Polish) their operands:
+  // * is unary, + and the concatenation token are binary.
+  static RegexImpl* FromPolishNotation(std::basic_string_view<CharT> str);
+  static RegexImpl* FromReversePolishNotation(
+      std::basic_string_view<CharT> str);
 
-  ~RegexQuantified() override { delete m_regex_; }
+  RegexImpl* Copy() const { return new RegexImpl(*this); }
 
-  static bool Classof(const RegexImpl<Alphabet>* regex) {
-    return !regex || regex->GetKind() == RegexImpl<Alphabet>::RK_Kleene ||
-           regex->GetKind() == RegexImpl<Alphabet>::RK_Optional;
+  Id Root() const {
+    assert(!is_open_);
+    return root_;
   }
 
-  static RegexImpl<Alphabet>* FromString(TokenIterator<Alphabet>& it) {
-    TokenIterator<Alphabet> backup = it;
-    RegexImpl<Alphabet>* regex = RegexSimple<Alphabet>::FromString(it);
-    if (!regex) {
-      it = backup;
-      return nullptr;
-    }
+  size_t Size() const { return nodes_.size(); }
 
-    if (it->type == RegexToken<Alphabet>::Type::QuestionMark) {
-      ++it;
-      return new RegexQuantified(regex, RegexImpl<Alphabet>::RK_Optional);
-    }
+  RegexKind GetKind() const { return GetKind(Root()); }
 
-    if (it->type == RegexToken<Alphabet>::Type::KleeneStar) {
-      ++it;
-      return new RegexQuantified(regex, RegexImpl<Alphabet>::RK_Kleene);
-    }
+  RegexKind GetKind(Id id) const { return nodes_[id].kind; }
 
-    return regex;
+  uint64_t GetLetter(Id id) const {
+    assert(GetKind(id) == RK_Letter);
+    return nodes_[id].letter;
   }
 
-  RegexQuantified* Copy() const override {
-    return new RegexQuantified(m_regex_->Copy(), this->GetKind());
-  }
+  CharT GetLetterChr(Id id) const { return Alphabet::Chr(GetLetter(id)); }
 
-  virtual void Reverse() override { m_regex_->Reverse(); }
-};
+  std::span<const Id> GetSubregex(Id id) const {
+    const Node& node = nodes_[id];
+    return {children_.data() + node.begin, children_.data() + node.end};
+  }
 
-template <typename Alphabet>
-class RegexConcatenate : public RegexImpl<Alphabet> {
-  friend class Regex<Alphabet>;
-  std::vector<RegexImpl<Alphabet>*> regex_;
-  RegexConcatenate()
-      : RegexImpl<Alphabet>(RegexImpl<Alphabet>::RK_Concatenate) {}
+  uint64_t Hash() const { return Hash(Root()); }
 
- public:
-  const std::vector<RegexImpl<Alphabet>*>& GetSubregex() const {
-    return regex_;
-  }
-  std::vector<RegexImpl<Alphabet>*>& GetSubregex() { return regex_; }
+  uint64_t Hash(Id id) const { return nodes_[id].hash; }
 
-  ~RegexConcatenate() override {
-    for (auto m_regex : regex_) {
-      delete m_regex;
+  // Deep comparison of subtree `id` with subtree `oth_id` of `oth`. Within
+  // one arena it is O(1). Arenas are hash-consed separately, so across
+  // arenas it walks the two DAGs in step; an equal subtree has one id per
+  // arena, so each node of `oth` is matched once and the walk is linear in
+  // the number of distinct nodes, not in the size of the expanded tree.
+  // Unequal regexes almost always differ in the stored hash and return at
+  // once. In RegexFromFDFA, where every new regex is looked up in a hash
+  // map, this is about 5% of the run time on a 64-state DFA.
+  bool Equal(Id id, const RegexImpl& oth, Id oth_id) const {
+    if (&oth == this) {
+      return id == oth_id;
+    }
+    // Subtrees of `oth_id` have smaller ids.
+    std::vector<Id> matched(oth_id + 1, kNoNode);
+    std::vector<std::pair<Id, Id>> stack = {{id, oth_id}};
+    while (!stack.empty()) {
+      auto [lhs, rhs] = stack.back();
+      stack.pop_back();
+      if (matched[rhs] == lhs) {
+        continue;
+      }
+      const Node& node = nodes_[lhs];
+      const Node& oth_node = oth.nodes_[rhs];
+      if (matched[rhs] != kNoNode || node.hash != oth_node.hash ||
+          node.kind != oth_node.kind || node.letter != oth_node.letter ||
+          node.end - node.begin != oth_node.end - oth_node.begin) {
+        return false;
+      }
+      matched[rhs] = lhs;
+      for (Id i = 0; i < node.end - node.begin; ++i) {
+        stack.emplace_back(children_[node.begin + i],
+                           oth.children_[oth_node.begin + i]);
+      }
     }
+    return true;
   }
 
-  static bool Classof(const RegexImpl<Alphabet>* regex) {
-    return !regex || regex->GetKind() == RegexImpl<Alphabet>::RK_Concatenate;
+  bool operator==(const RegexImpl& oth) const {
+    return Equal(Root(), oth, oth.Root());
   }
+};
 
-  static RegexImpl<Alphabet>* FromString(TokenIterator<Alphabet>& it) {
-    TokenIterator<Alphabet> backup = it;
-    RegexImpl<Alphabet>* regex1 = RegexQuantified<Alphabet>::FromString(it);
-    if (!regex1) {
-      it = backup;
-      return nullptr;
-    }
-
-    backup = it;
+/*
+ * Single pass parser with an explicit stack, so it takes linear time and
+ * constant native stack on any input.
+ *
+ * Every open bracket (and the whole regex) is a frame. Operands of all open
+ * frames share `stack_`: a frame owns stack_[alternatives, end), where the
+ * alternatives parsed so far come first and the items of the concatenation
+ * being parsed start at `items`.
+ */
+template <typename Alphabet>
+class RegexImpl<Alphabet>::Parser {
+  using Type = RegexToken<Alphabet>::Type;
 
-    RegexImpl<Alphabet>* regex2 = RegexQuantified<Alphabet>::FromString(it);
-    if (!regex2) {
-      it = backup;
-      return regex1;
-    }
+  struct Frame {
+    size_t alternatives;
+    size_t items;
+    bool quantifiable;  // The last item may take * or ?.
+  };
 
-    backup = it;
-    auto* rgx = new RegexConcatenate<Alphabet>;
-    rgx->regex_.push_back(regex1);
-    rgx->regex_.push_back(regex2);
+  RegexImpl& rgx_;
+  std::vector<Id> stack_;
+  std::vector<Frame> frames_;
 
-    while (RegexImpl<Alphabet>* sub_regex =
-               RegexQuantified<Alphabet>::FromString(it)) {
-      rgx->regex_.push_back(sub_regex);
-      backup = it;
+  // Replaces stack_[first, end) by one node, a list if there are several.
+  bool Reduce(RegexKind kind, size_t first) {
+    if (first == stack_.size()) {
+      return false;
+    }
+    if (stack_.size() - first > 1) {
+      Id list = rgx_.AddList(
+          kind, std::span<const Id>(stack_.begin() + first, stack_.end()));
+      stack_.resize(first);
+      stack_.push_back(list);
     }
+    return true;
+  }
 
-    it = backup;
-    return rgx;
+  bool CloseFrame() {
+    Frame frame = frames_.back();
+    frames_.pop_back();
+    return Reduce(RK_Concatenate, frame.items) &&
+           Reduce(RK_Alternate, frame.alternatives);
   }
 
-  RegexConcatenate* Copy() const override {
-    auto* copy = new RegexConcatenate();
-    for (auto* sub : regex_) {
-      copy->regex_.push_back(sub->Copy());
-    }
-    return copy;
+  void PushItem(Id item) {
+    stack_.push_back(item);
+    frames_.back().quantifiable = true;
   }
 
-  virtual void Reverse() override {
-    std::reverse(regex_.begin(), regex_.end());
-    for (RegexImpl<Alphabet>* r : regex_) {
-      r->Reverse();
+ public:
+  explicit Parser(RegexImpl& rgx) : rgx_(rgx) {}
+
+  // Returns the root, or kNoNode if the tokens aren't a regex.
+  Id Parse(TokenIterator<Alphabet> it) {
+    frames_.push_back({0, 0, false});
+    for (;; ++it) {
+      Frame& frame = frames_.back();
+      switch (it->type) {
+        case Type::Letter:
+          PushItem(rgx_.AddLetter(it->chr));
+          break;
+
+        case Type::Empty:
+          PushItem(rgx_.AddEmpty());
+          break;
+
+        case Type::KleeneStar:
+        case Type::QuestionMark:
+          if (!frame.quantifiable) {
+            return kNoNode;
+          }
+          stack_.back() = rgx_.AddQuantified(
+              stack_.back(),
+              it->type == Type::KleeneStar ? RK_Kleene : RK_Optional);
+          frame.quantifiable = false;
+          break;
+
+        case Type::Alternate:
+          if (!Reduce(RK_Concatenate, frame.items)) {
+            return kNoNode;
+          }
+          frame.items = stack_.size();
+          frame.quantifiable = false;
+          break;
+
+        case Type::LBracket:
+          frames_.push_back({stack_.size(), stack_.size(), false});
+          break;
+
+        case Type::RBracket:
+          if (frames_.size() == 1 || !CloseFrame()) {
+            return kNoNode;
+          }
+          frames_.back().quantifiable = true;
+          break;
+
+        case Type::EOL:
+          if (frames_.size() != 1 || !CloseFrame()) {
+            return kNoNode;
+          }
+          return stack_.back();
+
+        case Type::Error:
+        case Type::Concatenate:
+        default:
+          return kNoNode;
+      }
     }
   }
 };
 
 template <typename Alphabet>
-class RegexAlternate : public RegexImpl<Alphabet> {
-  friend class Regex<Alphabet>;
-  std::vector<RegexImpl<Alphabet>*> regex_;
-  RegexAlternate() : RegexImpl<Alphabet>(RegexImpl<Alphabet>::RK_Alternate) {}
+RegexImpl<Alphabet>* RegexImpl<Alphabet>::FromString(
+    std::basic_string_view<CharT> str) {
+  auto* rgx = new RegexImpl;
+  rgx->root_ = Parser(*rgx).Parse(Tokenizer<Alphabet>{str}.begin());
 
- public:
-  const std::vector<RegexImpl<Alphabet>*>& GetSubregex() const {
-    return regex_;
+  if (rgx->root_ == kNoNode) {
+    delete rgx;
+    return nullptr;
   }
-  std::vector<RegexImpl<Alphabet>*>& GetSubregex() { return regex_; }
 
-  ~RegexAlternate() override {
-    for (auto m_regex : regex_) {
-      delete m_regex;
-    }
-  }
+  return rgx;
+}
 
-  static bool Classof(const RegexImpl<Alphabet>* regex) {
-    return !regex || regex->GetKind() == RegexImpl<Alphabet>::RK_Alternate;
-  }
+/*
+ * One pass reader of Polish and reverse Polish notation. Operands wait on
+ * `operands_`. A concatenation or alternation that may still grow is kept
+ * open: its items stay on top of `items_` and its node is built once another
+ * operator takes it, so a chain of n binary operators costs O(n).
+ *
+ * Lists flatten like Regex::Concat and Regex::Alternate: the left operand
+ * is extended, the right one is nested.
+ */
+template <typename Alphabet>
+class RegexImpl<Alphabet>::PolishReader {
+  using Type = RegexToken<Alphabet>::Type;
 
-  static RegexImpl<Alphabet>* FromString(TokenIterator<Alphabet>& it) {
-    TokenIterator<Alphabet> backup = it;
-    RegexImpl<Alphabet>* regex1 = RegexConcatenate<Alphabet>::FromString(it);
-    if (!regex1) {
-      it = backup;
-      return nullptr;
-    }
+  struct Operand {
+    Id id;  // kNoNode while the list is open.
+    RegexKind kind;
+    size_t items;  // First item of an open list.
+  };
 
-    backup = it;
+  struct Pending {
+    Type op;
+    size_t missing;  // Operands it still waits for.
+  };
 
-    if (it->type != RegexToken<Alphabet>::Type::Alternate) {
-      return regex1;
-    }
+  RegexImpl& rgx_;
+  std::vector<Operand> operands_;
+  std::vector<Id> items_;
+  std::vector<Pending> pending_;
 
-    auto* rgx = new RegexAlternate<Alphabet>;
-    rgx->regex_.push_back(regex1);
+  void PushLeaf(Id id) { operands_.push_back({id, rgx_.GetKind(id), 0}); }
 
-    while (it->type == RegexToken<Alphabet>::Type::Alternate) {
-      ++it;
-      RegexImpl<Alphabet>* sub_regex =
-          RegexConcatenate<Alphabet>::FromString(it);
+  Id Close(Operand& operand) {
+    if (operand.id == kNoNode) {
+      operand.id = rgx_.AddList(
+          operand.kind,
+          std::span<const Id>(items_.begin() + operand.items, items_.end()));
+      items_.resize(operand.items);
+    }
+    return operand.id;
+  }
 
-      if (!sub_regex) {
-        break;
+  bool Apply(Type op) {
+    if (op == Type::KleeneStar) {
+      if (operands_.empty()) {
+        return false;
       }
+      Id sub = Close(operands_.back());
+      operands_.pop_back();
+      PushLeaf(rgx_.AddQuantified(sub, RK_Kleene));
+      return true;
+    }
+
+    if (operands_.size() < 2) {
+      return false;
+    }
+    Id rhs = Close(operands_.back());
+    operands_.pop_back();
+    Operand& lhs = operands_.back();
+    RegexKind kind = op == Type::Alternate ? RK_Alternate : RK_Concatenate;
+
+    if (kind == RK_Concatenate) {
+      if (rgx_.GetKind(rhs) == RK_Empty) {
+        return true;
+      }
+      if (lhs.id != kNoNode && lhs.kind == RK_Empty) {
+        lhs = {rhs, rgx_.GetKind(rhs), 0};
+        return true;
+      }
+    }
 
-      rgx->regex_.push_back(sub_regex);
-      backup = it;
+    if (lhs.kind != kind) {
+      Id first = Close(lhs);
+      lhs = {kNoNode, kind, items_.size()};
+      items_.push_back(first);
+    } else if (lhs.id != kNoNode) {
+      auto subs = rgx_.GetSubregex(lhs.id);
+      lhs = {kNoNode, kind, items_.size()};
+      items_.insert(items_.end(), subs.begin(), subs.end());
     }
+    items_.push_back(rhs);
+    return true;
+  }
+
+  // Pushes a leaf, if it is an operand.
+  bool ReadLeaf(const RegexToken<Alphabet>& token) {
+    if (token.type == Type::Letter) {
+      PushLeaf(rgx_.AddLetter(token.chr));
+      return true;
+    }
+    if (token.type == Type::Empty) {
+      PushLeaf(rgx_.AddEmpty());
+      return true;
+    }
+    return false;
+  }
 
-    it = backup;
-    return rgx;
+  static bool IsOperator(Type type) {
+    return type == Type::KleeneStar || type == Type::Alternate ||
+           type == Type::Concatenate;
   }
 
-  RegexAlternate* Copy() const override {
-    auto* copy = new RegexAlternate();
-    for (auto* sub : regex_) {
-      copy->regex_.push_back(sub->Copy());
+ public:
+  explicit PolishReader(RegexImpl& rgx) : rgx_(rgx) {}
+
+  // Return the root, or kNoNode if the tokens aren't a regex.
+  Id ReadPolish(TokenIterator<Alphabet> it) {
+    for (;; ++it) {
+      if (IsOperator(it->type)) {
+        size_t arity = it->type == Type::KleeneStar ? 1 : 2;
+        pending_.push_back({it->type, arity});
+        continue;
+      }
+      if (!ReadLeaf(*it)) {
+        return kNoNode;
+      }
+      while (!pending_.empty() && --pending_.back().missing == 0) {
+        Apply(pending_.back().op);
+        pending_.pop_back();
+      }
+      if (pending_.empty()) {
+        ++it;
+        return it->type == Type::EOL ? Close(operands_.back()) : kNoNode;
+      }
     }
-    return copy;
   }
 
-  virtual void Reverse() override {
-    for (RegexImpl<Alphabet>* r : regex_) {
-      r->Reverse();
+  Id ReadReversePolish(TokenIterator<Alphabet> it) {
+    for (;; ++it) {
+      if (IsOperator(it->type)) {
+        if (!Apply(it->type)) {
+          return kNoNode;
+        }
+      } else if (it->type == Type::EOL) {
+        return operands_.size() == 1 ? Close(operands_.back()) : kNoNode;
+      } else if (!ReadLeaf(*it)) {
+        return kNoNode;
+      }
     }
   }
 };
 
 template <typename Alphabet>
-RegexImpl<Alphabet>* RegexImpl<Alphabet>::FromString(
-    TokenIterator<Alphabet>& it) {
-  return RegexAlternate<Alphabet>::FromString(it);
-}
-
-template <class OStream, typename Alphabet>
-OStream& operator<<(OStream& out, const RegexImpl<Alphabet>& rgx);
-
-template <class OStream, typename Alphabet>
-OStream& operator<<(OStream& out, const RegexLetter<Alphabet>& rgx) {
-  typename Alphabet::CharT letter = rgx.GetLetterChr();
-  if (Alphabet::NeedEscape(letter)) {
-    out << Alphabet::kEscapeChar;
+RegexImpl<Alphabet>* RegexImpl<Alphabet>::FromPolishNotation(
+    std::basic_string_view<CharT> str) {
+  auto* rgx = new RegexImpl;
+  rgx->root_ = PolishReader(*rgx).ReadPolish(Tokenizer<Alphabet>{str}.begin());
+  if (rgx->root_ == kNoNode) {
+    delete rgx;
+    return nullptr;
   }
-  out << letter;
-  return out;
+  return rgx;
 }
 
-template <class OStream, typename Alphabet>
-OStream& operator<<(OStream& out, const RegexQuantified<Alphabet>& rgx) {
-  if (rgx.GetSubregex()->GetKind() >= rgx.GetKind()) {
-    out << Alphabet::kLBracket;
-  }
-
-  out << *rgx.GetSubregex();
-
-  if (rgx.GetSubregex()->GetKind() >= rgx.GetKind()) {
-    out << Alphabet::kRBracket;
+template <typename Alphabet>
+RegexImpl<Alphabet>* RegexImpl<Alphabet>::FromReversePolishNotation(
+    std::basic_string_view<CharT> str) {
+  auto* rgx = new RegexImpl;
+  rgx->root_ =
+      PolishReader(*rgx).ReadReversePolish(Tokenizer<Alphabet>{str}.begin());
+  if (rgx->root_ == kNoNode) {
+    delete rgx;
+    return nullptr;
   }
-
-  out << (rgx.GetKind() == RegexImpl<Alphabet>::RK_Kleene
-              ? Alphabet::kStar
-              : Alphabet::kQuestionMark);
-  return out;
+  return rgx;
 }
 
+namespace details {
 template <class OStream, typename Alphabet>
-OStream& operator<<(OStream& out, const RegexConcatenate<Alphabet>& rgx) {
-  for (const auto* sub : rgx.GetSubregex()) {
-    if (sub->GetKind() >= rgx.GetKind()) {
-      out << Alphabet::kLBracket;
+void PrintRegex(OStream& out, const RegexImpl<Alphabet>& rgx,
+                typename RegexImpl<Alphabet>::Id root) {
+  using Impl = RegexImpl<Alphabet>;
+  using CharT = typename Alphabet::CharT;
+  // Pending output, last item first: a subexpression to print or, if
+  // `is_text`, a single character. The explicit stack keeps deep nesting
+  // off the native stack.
+  struct Item {
+    typename Impl::Id id;
+    CharT text;
+    bool is_text;
+  };
+  std::vector<Item> stack = {{root, CharT{}, false}};
+  auto push_text = [&](CharT text) { stack.push_back({root, text, true}); };
+  auto push_sub = [&](typename Impl::Id id, typename Impl::Id sub) {
+    bool brackets = rgx.GetKind(sub) >= rgx.GetKind(id);
+    if (brackets) {
+      push_text(Alphabet::kRBracket);
     }
-    out << *sub;
-    if (sub->GetKind() >= rgx.GetKind()) {
-      out << Alphabet::kRBracket;
+    stack.push_back({sub, CharT{}, false});
+    if (brackets) {
+      push_text(Alphabet::kLBracket);
     }
-  }
-  return out;
-}
+  };
 
-template <class OStream, typename Alphabet>
-OStream& operator<<(OStream& out, const RegexAlternate<Alphabet>& rgx) {
-  out << *rgx.GetSubregex()[0];
-  for (size_t i = 1; i < rgx.GetSubregex().size(); ++i) {
-    out << Alphabet::kPlus << *rgx.GetSubregex()[i];
+  while (!stack.empty()) {
+    Item item = stack.back();
+    stack.pop_back();
+    if (item.is_text) {
+      out << item.text;
+      continue;
+    }
+
+    auto id = item.id;
+    auto subs = rgx.GetSubregex(id);
+    switch (rgx.GetKind(id)) {
+      case Impl::RK_Letter: {
+        CharT letter = rgx.GetLetterChr(id);
+        if (Alphabet::NeedEscape(letter)) {
+          out << Alphabet::kEscapeChar;
+        }
+        out << letter;
+        break;
+      }
+      case Impl::RK_Empty:
+        out << Alphabet::kEmptyWord;
+        break;
+      case Impl::RK_Kleene:
+      case Impl::RK_Optional:
+        push_text(rgx.GetKind(id) == Impl::RK_Kleene ? Alphabet::kStar
+                                                     : Alphabet::kQuestionMark);
+        push_sub(id, subs[0]);
+        break;
+      case Impl::RK_Concatenate:
+        for (size_t i = subs.size(); i-- > 0;) {
+          push_sub(id, subs[i]);
+        }
+        break;
+      case Impl::RK_Alternate:
+        for (size_t i = subs.size(); i-- > 1;) {
+          stack.push_back({subs[i], CharT{}, false});
+          push_text(Alphabet::kPlus);
+        }
+        stack.push_back({subs[0], CharT{}, false});
+        break;
+      default:
+        assert(false && "Bad regex");
+    }
   }
-  return out;
 }
+}  // namespace details
 
 template <class OStream, typename Alphabet>
 OStream& operator<<(OStream& out, const RegexImpl<Alphabet>& rgx) {
-  switch (rgx.GetKind()) {
-    case RegexImpl<Alphabet>::RK_Letter:
-      out << *mgk::Cast<RegexLetter<Alphabet>>(rgx);
-      return out;
-    case RegexImpl<Alphabet>::RK_Kleene:
-    case RegexImpl<Alphabet>::RK_Optional:
-      out << *mgk::Cast<RegexQuantified<Alphabet>>(rgx);
-      return out;
-    case RegexImpl<Alphabet>::RK_Alternate:
-      out << *mgk::Cast<RegexAlternate<Alphabet>>(rgx);
-      return out;
-    case RegexImpl<Alphabet>::RK_Concatenate:
-      out << *mgk::Cast<RegexConcatenate<Alphabet>>(rgx);
-      return out;
-    case RegexImpl<Alphabet>::RK_Empty:
-      assert(mgk::Cast<RegexEmpty<Alphabet>>(rgx));
-      out << Alphabet::kEmptyWord;
-      return out;
-    default:
-      assert(false && "Bad regex");
-  }
+  details::PrintRegex(out, rgx, rgx.Root());
   return out;
 }
 
 template <typename Alphabet>
 class Regex {
   using CharT = Alphabet::CharT;
-  RegexImpl<Alphabet>* impl_ = nullptr;
+  using Impl = RegexImpl<Alphabet>;
+  Impl* impl_ = nullptr;
   size_t* n_owns_ = nullptr;
 
-  explicit Regex(RegexImpl<Alphabet>* rgx)
-      : impl_(rgx), n_owns_(new size_t(1)) {
+  explicit Regex(Impl* rgx) : impl_(rgx), n_owns_(new size_t(1)) {
     assert(impl_);
   }
 
+  static Regex Letter(uint64_t letter) {
+    auto* rgx = new Impl;
+    rgx->root_ = rgx->AddLetter(letter);
+    return Regex(rgx);
+  }
+
   // MUST be called on every non-const method;
   void Modify() {
     if (*n_owns_ != 1) {
@@ -452,70 +769,19 @@ class Regex {
     }
   }
 
-  void Forget() {
-    assert(*n_owns_ == 1);
-    delete n_owns_;
-    n_owns_ = nullptr;
-    impl_ = nullptr;
-  }
-
-  static Regex FromPolishNotationImpl(TokenIterator<Alphabet>& it) {
-    switch (it->type) {
-      case RegexToken<Alphabet>::Type::Letter: {
-        Regex r{new RegexLetter<Alphabet>(it->chr)};
-        it++;
-        return std::move(r);
-      }
-
-      case RegexToken<Alphabet>::Type::KleeneStar: {
-        it++;
-        Regex r = FromPolishNotationImpl(it);
-        if (!r.GetImpl()) return {};
-        r.Kleene();
-        return std::move(r);
-      }
-
-      case RegexToken<Alphabet>::Type::Alternate: {
-        it++;
-        Regex r = FromPolishNotationImpl(it);
-        if (!r.GetImpl()) return {};
-        r.Alternate(FromPolishNotationImpl(it));
-        return std::move(r);
-      }
-
-      case RegexToken<Alphabet>::Type::Concatenate: {
-        it++;
-        Regex r = FromPolishNotationImpl(it);
-        if (!r.GetImpl()) return {};
-        r.Concat(FromPolishNotationImpl(it));
-        return std::move(r);
-      }
-
-      case RegexToken<Alphabet>::Type::Empty:
-        return EmptyString();
-
-      case RegexToken<Alphabet>::Type::Error:
-      case RegexToken<Alphabet>::Type::QuestionMark:
-      case RegexToken<Alphabet>::Type::LBracket:
-      case RegexToken<Alphabet>::Type::RBracket:
-      case RegexToken<Alphabet>::Type::EOL:
-      default:
-        return {};
-    }
-  }
-
  public:
   Regex() : impl_(nullptr) {}
 
   explicit Regex(std::basic_string_view<typename Alphabet::CharT> str)
-      : impl_(RegexImpl<Alphabet>::FromString(str)), n_owns_(new size_t(1)) {
+      : impl_(Impl::FromString(str)), n_owns_(new size_t(1)) {
     if (!impl_) {
+      delete n_owns_;
       throw std::runtime_error("Not a regex");
     }
   }
 
   Regex(const Regex& oth) : impl_(oth.impl_), n_owns_(oth.n_owns_) {
-    (*n_owns_)++;
+    if (n_owns_) (*n_owns_)++;
   }
 
   Regex& operator=(const Regex& oth) {
@@ -544,50 +810,54 @@ class Regex {
     }
   }
 
-  static Regex EmptyString() { return Regex(new RegexEmpty<Alphabet>); }
-
-  static Regex SingeLetter(CharT chr) {
-    return Regex(new RegexLetter<Alphabet>(Alphabet::Ord(chr)));
+  static Regex EmptyString() {
+    auto* rgx = new Impl;
+    rgx->root_ = rgx->AddEmpty();
+    return Regex(rgx);
   }
 
+  static Regex SingeLetter(CharT chr) { return Letter(Alphabet::Ord(chr)); }
+
+  // Both return an empty Regex if `sv` is malformed, the same as the empty
+  // language; use the Parse* versions below to tell the two apart.
   static Regex FromPolishNotation(std::basic_string_view<CharT> sv) {
-    Tokenizer<Alphabet> tokenizer{sv};
-    TokenIterator<Alphabet> it = tokenizer.begin();
-    return FromPolishNotationImpl(it);
+    return ParsePolishNotation(sv).value_or(Regex());
+  }
+
+  static Regex FromReversePolishNotation(std::basic_string_view<CharT> sv) {
+    return ParseReversePolishNotation(sv).value_or(Regex());
+  }
+
+  // Both return nullopt if `sv` is malformed.
+  static std::optional<Regex> ParsePolishNotation(
+      std::basic_string_view<CharT> sv) {
+    Impl* rgx = Impl::FromPolishNotation(sv);
+    return rgx ? std::optional<Regex>(Regex(rgx)) : std::nullopt;
   }
 
-  static Regex FromReversePolishNotation(std::basic_string<CharT> str) {
-    std::reverse(str.begin(), str.end());
-    auto r = FromPolishNotation(str);
-    r.Reverse();
-    return std::move(r);
+  static std::optional<Regex> ParseReversePolishNotation(
+      std::basic_string_view<CharT> sv) {
+    Impl* rgx = Impl::FromReversePolishNotation(sv);
+    return rgx ? std::optional<Regex>(Regex(rgx)) : std::nullopt;
   }
 
-  const RegexImpl<Alphabet>* GetImpl() const { return impl_; }
+  const Impl* GetImpl() const { return impl_; }
 
+  // A chain of n calls takes O(n) time and space: the root list keeps room
+  // to grow in its arena, so an append rarely copies it.
   Regex& Concat(Regex oth) {
-    if (!impl_ || mgk::Isa<RegexEmpty<Alphabet>>(*impl_)) {
+    if (!impl_ || impl_->GetKind() == Impl::RK_Empty) {
       return *this = std::move(oth);
     }
 
-    if (mgk::Isa<RegexEmpty<Alphabet>>(*oth.impl_)) {
+    if (!oth.impl_ || oth.impl_->GetKind() == Impl::RK_Empty) {
       return *this;
     }
 
     Modify();
-    oth.Modify();  // Make oth single-owner;
-
-    if (mgk::Isa<RegexConcatenate<Alphabet>, RegexImpl<Alphabet>>(impl_)) {
-      mgk::Cast<RegexConcatenate<Alphabet>>(impl_)->GetSubregex().push_back(
-          oth.impl_);
-    } else {
-      auto* rgx = new RegexConcatenate<Alphabet>;
-      rgx->GetSubregex().push_back(impl_);
-      rgx->GetSubregex().push_back(oth.impl_);
-      impl_ = rgx;
-    }
-
-    oth.Forget();
+    impl_->Open(Impl::RK_Concatenate);
+    impl_->Append(impl_->Import(*oth.GetImpl()));
+    impl_->Close();
     return *this;
   }
 
@@ -596,47 +866,48 @@ class Regex {
       return *this = std::move(oth);
     }
 
-    Modify();
-    oth.Modify();  // Make oth single-owner;
-
-    if (mgk::Isa<RegexAlternate<Alphabet>, RegexImpl<Alphabet>>(impl_)) {
-      mgk::Cast<RegexAlternate<Alphabet>>(impl_)->GetSubregex().push_back(
-          oth.impl_);
-    } else {
-      auto* rgx = new RegexAlternate<Alphabet>;
-      rgx->GetSubregex().push_back(impl_);
-      rgx->GetSubregex().push_back(oth.impl_);
-      impl_ = rgx;
+    if (!oth.impl_) {
+      return *this;
     }
 
-    oth.Forget();
+    Modify();
+    impl_->Open(Impl::RK_Alternate);
+    impl_->Append(impl_->Import(*oth.GetImpl()));
+    impl_->Close();
     return *this;
   }
 
   Regex& Kleene() {
     assert(impl_);
     Modify();
-    impl_ =
-        new RegexQuantified<Alphabet>(impl_, RegexImpl<Alphabet>::RK_Kleene);
+    impl_->root_ = impl_->AddQuantified(impl_->Root(), Impl::RK_Kleene);
     return *this;
   }
 
   Regex& Optional() {
     assert(impl_);
     Modify();
-    impl_ =
-        new RegexQuantified<Alphabet>(impl_, RegexImpl<Alphabet>::RK_Optional);
+    impl_->root_ = impl_->AddQuantified(impl_->Root(), Impl::RK_Optional);
     return *this;
   }
 
   Regex& Reverse() {
-    if (impl_) impl_->Reverse();
+    if (impl_) {
+      Modify();
+      impl_->Reverse();
+    }
     return *this;
   }
 
-  // Shallow ==
-  bool operator==(const Regex& other) const = default;
-  bool operator!=(const Regex& other) const = default;
+  // Structural, equal trees compare equal wherever they are stored.
+  bool operator==(const Regex& other) const {
+    if (impl_ == other.impl_) {
+      return true;
+    }
+    return impl_ && other.impl_ && *GetImpl() == *other.GetImpl();
+  }
+
+  uint64_t Hash() const { return impl_ ? GetImpl()->Hash() : 0; }
 };
 template <typename OStream, typename Alphabet>
 OStream& operator<<(OStream& out, const Regex<Alphabet>& rgx) {
@@ -650,4 +921,11 @@ OStream& operator<<(OStream& out, const Regex<Alphabet>& rgx) {
 
 }  // namespace rgx
 
+template <typename Alphabet>
+struct std::hash<rgx::Regex<Alphabet>> {
+  size_t operator()(const rgx::Regex<Alphabet>& regex) const {
+    return regex.Hash();
+  }
+};
+
 #endif /* REGEX_REGEX_HPP */
@@ -0,0 +1,398 @@
+#ifndef REGEX_SEARCH_HPP
+#define REGEX_SEARCH_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "fdfa.hpp"
+#include "frozen_dfa.hpp"
+#include "nfa.hpp"
+#include "regex.hpp"
+#include "tranforms.hpp"
+
+namespace rgx {
+
+// Match of sv[begin, end).
+struct SearchMatch {
+  size_t begin;
+  size_t end;
+
+  bool operator==(const SearchMatch&) const = default;
+};
+
+/*
+ * Unanchored leftmost-longest search: the match starting leftmost, and of
+ * those the longest. Matches never contain characters outside the alphabet;
+ * the search restarts after them.
+ *
+ * Three DFAs are built from the pattern's:
+ *   unanchored_ runs .*R forward and accepts right after every match end.
+ *   reverse_ runs .*R' (R' is R reversed) backwards from the last match end
+ *     and accepts right before every match start.
+ *   anchored_ runs R from a start to find the longest match there.
+ *
+ * FindAll and Count make one pass with each: anchored_ runs from every match
+ * start at once, and runs that reach the same state are merged, since they
+ * see the same ends from then on. A search takes O(n * m) time for a text of
+ * length n and m states of anchored_, instead of an anchored run from every
+ * start, which may read to the end of the text each time. FindFirst stops
+ * as soon as the first match is known.
+ */
+template <typename Alphabet, typename StateT = uint32_t>
+class Searcher {
+  using CharT = typename Alphabet::CharT;
+
+ public:
+  using DFA = FrozenFDFA<Alphabet, StateT>;
+  static const constexpr size_t kNoMatch = DFA::kNoMatch;
+
+ private:
+  using State = typename DFA::State;
+
+  DFA anchored_;
+  DFA unanchored_;
+  DFA reverse_;
+
+  /*
+   * Anchored run from one start, in a union-find forest of runs that met in
+   * one state. The longest match of a run ends at its own last accept or at
+   * the last accept of a group above it after it joined, whichever is later.
+   * Find() folds the accepts of the nodes it skips into `last`.
+   */
+  struct Run {
+    size_t parent;  // Itself for a group.
+    size_t join;    // Offset at which it joined its parent.
+    size_t last;    // Last accept while it was a group, or kNoMatch.
+    size_t start;
+    bool dead = false;  // For groups: no more accepts.
+  };
+
+  // Minimal DFA of .*L, where L is the language of `fdfa` or, if `reverse`,
+  // its reversal.
+  template <typename Node>
+  static FDFA<Alphabet> Unanchored(const FDFA<Alphabet, Node>& fdfa,
+                                   bool reverse) {
+    const Node kErrorState = FDFA<Alphabet, Node>::kErrorState;
+    const uint64_t kEpsilon = NFSA<Alphabet>::kEpsilon;
+    // State 0 loops on every symbol, `fdfa` state v becomes v + 1.
+    NFSA<Alphabet> nfa;
+    nfa.Reserve(fdfa.Size() + 1);
+    for (size_t node = 0; node < fdfa.Size(); ++node) {
+      nfa.CreateNode();
+    }
+    for (uint64_t via = 1; via < Alphabet::kSize; ++via) {
+      nfa.AddTransition(0, via, 0);
+    }
+    for (size_t from = 0; from < fdfa.Size(); ++from) {
+      for (uint64_t via = 1; via < Alphabet::kSize; ++via) {
+        size_t to = fdfa.Transitions(from)[via];
+        if (to == kErrorState) {
+          continue;
+        }
+        if (reverse) {
+          nfa.AddTransition(to + 1, via, from + 1);
+        } else {
+          nfa.AddTransition(from + 1, via, to + 1);
+        }
+      }
+    }
+    for (size_t node = 0; node < fdfa.Size(); ++node) {
+      if (reverse ? fdfa.IsFinite(node) : node == fdfa.Start()) {
+        nfa.AddTransition(0, kEpsilon, node + 1);
+      }
+      if (reverse ? node == fdfa.Start() : fdfa.IsFinite(node)) {
+        nfa.MakeFinite(node + 1);
+      }
+    }
+    nfa.RemoveEpsilonTransitions();
+    return Minimize(FDFAFromNFA(nfa));
+  }
+
+  // One past the end of the last match in `sv`, or kNoMatch.
+  size_t LastMatchEnd(std::basic_string_view<CharT> sv) const {
+    typename DFA::State state = unanchored_.Start();
+    if (state == DFA::kDead) {
+      return kNoMatch;
+    }
+    size_t last = unanchored_.IsFinite(state) ? 0 : kNoMatch;
+    for (size_t i = 0; i < sv.length(); ++i) {
+      state = unanchored_.Next(state, sv[i]);
+      // .*R only dies on characters outside the alphabet.
+      if (state == DFA::kDead) {
+        state = unanchored_.Start();
+      }
+      if (unanchored_.IsFinite(state)) {
+        last = i + 1;
+      }
+    }
+    return last;
+  }
+
+  // One past the end of the first match to end in `sv`, or kNoMatch.
+  size_t FirstMatchEnd(std::basic_string_view<CharT> sv) const {
+    State state = unanchored_.Start();
+    if (state == DFA::kDead) {
+      return kNoMatch;
+    }
+    for (size_t i = 0;; ++i) {
+      if (unanchored_.IsFinite(state)) {
+        return i;
+      }
+      if (i == sv.length()) {
+        return kNoMatch;
+      }
+      state = unanchored_.Next(state, sv[i]);
+      if (state == DFA::kDead) {
+        state = unanchored_.Start();
+      }
+    }
+  }
+
+  // Whether a match starts at each of [0, last].
+  std::vector<bool> MatchStarts(std::basic_string_view<CharT> sv,
+                                size_t last) const {
+    std::vector<bool> starts(last + 1);
+    typename DFA::State state = reverse_.Start();
+    starts[last] = reverse_.IsFinite(state);
+    for (size_t i = last; i-- > 0;) {
+      state = reverse_.Next(state, sv[i]);
+      if (state == DFA::kDead) {
+        state = reverse_.Start();
+      }
+      starts[i] = reverse_.IsFinite(state);
+    }
+    return starts;
+  }
+
+  // `last` if it is an accept at or after `join`, else kNoMatch.
+  static size_t AcceptAfter(size_t last, size_t join) {
+    return last != kNoMatch && last >= join ? last : kNoMatch;
+  }
+
+  static size_t Later(size_t lhs, size_t rhs) {
+    if (lhs == kNoMatch) return rhs;
+    if (rhs == kNoMatch) return lhs;
+    return std::max(lhs, rhs);
+  }
+
+  // Group of `run`. Points the path straight at it, keeping for every node
+  // on the path the accepts of the nodes it skips. `path` is scratch.
+  static size_t Find(std::vector<Run>& runs, size_t run,
+                     std::vector<size_t>& path) {
+    path.clear();
+    while (runs[run].parent != run) {
+      path.push_back(run);
+      run = runs[run].parent;
+    }
+    // Top down, so each node's parent already points at the group.
+    for (size_t i = path.size(); i-- > 0;) {
+      Run& node = runs[path[i]];
+      if (node.parent != run) {
+        const Run& parent = runs[node.parent];
+        node.last = Later(node.last, AcceptAfter(parent.last, node.join));
+        node.join = parent.join;
+        node.parent = run;
+      }
+    }
+    return run;
+  }
+
+  // Calls fn(match) for the matches in order while it returns true. After a
+  // match the search goes on from its end, or one character later if it's
+  // empty.
+  template <typename Fn>
+  void ForEachMatch(std::basic_string_view<CharT> sv, Fn fn) const {
+    size_t last = LastMatchEnd(sv);
+    if (last == kNoMatch) {
+      return;
+    }
+    std::vector<bool> starts = MatchStarts(sv, last);
+
+    // A run starts at every match start that may begin the next match, so
+    // `runs` is sorted by start. `groups` holds the live groups by state.
+    std::vector<Run> runs;
+    std::vector<std::pair<State, size_t>> groups;
+    std::vector<std::pair<State, size_t>> placed;
+    std::vector<size_t> stamp(anchored_.Size(), kNoMatch);
+    std::vector<size_t> slot(anchored_.Size());
+    std::vector<size_t> path;
+
+    // Adds `group`, in `state` at offset `pos`, to `placed`. Merges it into
+    // the group already placed in that state, if any.
+    auto place = [&](State state, size_t group, size_t pos) {
+      size_t row = state / anchored_.NumClasses();
+      if (stamp[row] == pos) {
+        runs[group].parent = placed[slot[row]].second;
+        runs[group].join = pos;
+        return;
+      }
+      stamp[row] = pos;
+      slot[row] = placed.size();
+      placed.emplace_back(state, group);
+      if (anchored_.IsFinite(state)) {
+        runs[group].last = pos;
+      }
+    };
+
+    size_t from = 0;     // Match start the next match begins at.
+    size_t current = 0;  // Its run, once started.
+    auto seek = [&]() {
+      while (from <= last && !starts[from]) {
+        ++from;
+      }
+      while (current < runs.size() && runs[current].start < from) {
+        ++current;
+      }
+      return from <= last;
+    };
+    seek();
+
+    for (size_t pos = from;; ++pos) {
+      bool died = false;
+      placed.clear();
+      for (auto [state, group] : groups) {
+        State to = anchored_.Next(state, sv[pos - 1]);
+        if (to == DFA::kDead) {
+          runs[group].dead = died = true;
+        } else {
+          place(to, group, pos);
+        }
+      }
+      if (pos >= from && starts[pos]) {
+        runs.push_back({runs.size(), pos, kNoMatch, pos});
+        place(anchored_.Start(), runs.size() - 1, pos);
+      }
+      groups.swap(placed);
+      // No match ends after `last`.
+      if (pos == last) {
+        for (auto [state, group] : groups) {
+          runs[group].dead = died = true;
+        }
+        groups.clear();
+      }
+
+      while (died && current < runs.size()) {
+        size_t group = Find(runs, current, path);
+        if (!runs[group].dead) {
+          break;
+        }
+        size_t end = runs[current].last;
+        if (group != current) {
+          end = Later(end, AcceptAfter(runs[group].last, runs[current].join));
+        }
+        assert(end != kNoMatch);
+        size_t begin = runs[current].start;
+        if (!fn(SearchMatch{begin, end})) {
+          return;
+        }
+        from = end > begin ? end : begin + 1;
+        if (!seek()) {
+          return;
+        }
+      }
+      // Every run started before the next match; jump to it.
+      if (current == runs.size() && from > pos) {
+        groups.clear();
+        pos = from - 1;
+      }
+    }
+  }
+
+ public:
+  template <typename Node>
+  explicit Searcher(const FDFA<Alphabet, Node>& fdfa)
+      : anchored_(fdfa),
+        unanchored_(Unanchored(fdfa, false)),
+        reverse_(Unanchored(fdfa, true)) {}
+
+  explicit Searcher(const Regex<Alphabet>& regex)
+      : Searcher(MDFAFromRegex(regex)) {}
+
+  // Reads the text only up to where the first match can't grow any more.
+  std::optional<SearchMatch> FindFirst(std::basic_string_view<CharT> sv) const {
+    size_t first_end = FirstMatchEnd(sv);
+    if (first_end == kNoMatch) {
+      return std::nullopt;
+    }
+    // The first match starts no later than the first end. Anchored runs
+    // start at every offset up to there; runs in one state see the same
+    // ends, so only the leftmost is kept. `runs` stays sorted by start.
+    std::vector<std::pair<State, size_t>> runs;
+    std::vector<std::pair<State, size_t>> next_runs;
+    std::vector<size_t> stamp(anchored_.Size(), kNoMatch);
+    std::optional<SearchMatch> best;
+    for (size_t pos = 0;; ++pos) {
+      if (pos <= first_end) {
+        runs.emplace_back(anchored_.Start(), pos);
+      }
+      next_runs.clear();
+      for (auto [state, start] : runs) {
+        size_t row = state / anchored_.NumClasses();
+        if (stamp[row] == pos) {
+          continue;
+        }
+        stamp[row] = pos;
+        if (best && start > best->begin) {
+          break;
+        }
+        if (anchored_.IsFinite(state)) {
+          best = SearchMatch{start, pos};
+        }
+        next_runs.emplace_back(state, start);
+      }
+      runs.clear();
+      if (pos == sv.length()) {
+        break;
+      }
+      for (auto [state, start] : next_runs) {
+        if (best && start > best->begin) {
+          break;
+        }
+        State to = anchored_.Next(state, sv[pos]);
+        if (to != DFA::kDead) {
+          runs.emplace_back(to, start);
+        }
+      }
+      if (best && runs.empty()) {
+        break;
+      }
+    }
+    return best;
+  }
+
+  // Non-overlapping matches, left to right.
+  std::vector<SearchMatch> FindAll(std::basic_string_view<CharT> sv) const {
+    std::vector<SearchMatch> matches;
+    ForEachMatch(sv, [&matches](SearchMatch match) {
+      matches.push_back(match);
+      return true;
+    });
+    return matches;
+  }
+
+  // Number of matches FindAll() finds.
+  size_t Count(std::basic_string_view<CharT> sv) const {
+    size_t count = 0;
+    ForEachMatch(sv, [&count](SearchMatch) {
+      ++count;
+      return true;
+    });
+    return count;
+  }
+
+  size_t MemoryUsage() const {
+    return sizeof(*this) + anchored_.MemoryUsage() +
+           unanchored_.MemoryUsage() + reverse_.MemoryUsage() -
+           3 * sizeof(DFA);
+  }
+};
+
+}  // namespace rgx
+
+#endif /* REGEX_SEARCH_HPP */
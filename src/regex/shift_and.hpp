@@ -0,0 +1,183 @@
+#ifndef REGEX_SHIFT_AND_HPP
+#define REGEX_SHIFT_AND_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "nfa.hpp"
+
+namespace rgx {
+
+/*
+ * Bit-parallel (Glushkov / Shift-And style) simulation of an epsilon-free
+ * NFSA with at most 64 * kWords states.
+ *
+ * Every bit is a position: a pair (NFA state, symbol it was entered by), plus
+ * bit 0 for the start. All edges into a position carry the same symbol, so
+ * one step is
+ *     next = Follow(state) & symbol_masks_[chr]
+ * where Follow is the union of successors of the active positions, looked up
+ * by 8 bits at a time in precomputed tables.
+ */
+template <typename Alphabet, std::size_t kWords = 1>
+class ShiftAndNFSA {
+  using CharT = typename Alphabet::CharT;
+
+ public:
+  using Mask = std::array<uint64_t, kWords>;
+  static const constexpr std::size_t kMaxStates = 64 * kWords;
+  static const constexpr std::size_t kNoMatch = NFSA<Alphabet>::kNoMatch;
+
+ private:
+  static const constexpr std::size_t kChunkBits = 8;
+  static const constexpr std::size_t kChunkSize = 1ul << kChunkBits;
+
+  std::size_t size_ = 1;
+  std::size_t chunks_ = 1;
+  Mask start_ = {};
+  Mask finite_ = {};
+  std::array<Mask, Alphabet::kSize> symbol_masks_ = {};
+  std::vector<Mask> follow_;  // chunks_ * kChunkSize
+
+  ShiftAndNFSA() = default;
+
+  static void Set(Mask& mask, std::size_t bit) {
+    mask[bit / 64] |= uint64_t{1} << (bit % 64);
+  }
+
+  static bool Any(const Mask& mask) {
+    return std::any_of(mask.begin(), mask.end(),
+                       [](uint64_t word) { return word != 0; });
+  }
+
+  static void Or(Mask& to, const Mask& from) {
+    for (std::size_t w = 0; w < kWords; ++w) {
+      to[w] |= from[w];
+    }
+  }
+
+  Mask Follow(const Mask& state) const {
+    Mask next = {};
+    for (std::size_t chunk = 0; chunk < chunks_; ++chunk) {
+      uint64_t bits =
+          (state[chunk * kChunkBits / 64] >> (chunk * kChunkBits % 64)) &
+          (kChunkSize - 1);
+      Or(next, follow_[chunk * kChunkSize + bits]);
+    }
+    return next;
+  }
+
+ public:
+  // Fails if `nfa` has epsilon transitions or needs more than kMaxStates
+  // positions.
+  template <typename Node>
+  static std::optional<ShiftAndNFSA> FromNFA(
+      const FrozenNFSA<Alphabet, Node>& nfa);
+
+  std::size_t Size() const { return size_; }
+
+  std::size_t MaxMatch(std::basic_string_view<CharT> sv) const;
+
+  std::size_t MemoryUsage() const {
+    return sizeof(*this) + follow_.size() * sizeof(Mask);
+  }
+};
+
+template <typename Alphabet, std::size_t kWords>
+template <typename Node>
+std::optional<ShiftAndNFSA<Alphabet, kWords>>
+ShiftAndNFSA<Alphabet, kWords>::FromNFA(const FrozenNFSA<Alphabet, Node>& nfa) {
+  if (nfa.IsAnyEpsilon()) {
+    return std::nullopt;
+  }
+
+  std::map<std::pair<Node, uint64_t>, std::size_t> positions;
+  for (std::size_t from = 0; from < nfa.Size(); ++from) {
+    for (const auto& edge : nfa.Transitions(from)) {
+      positions.emplace(std::make_pair(edge.to, edge.symbol), 0);
+    }
+  }
+  if (positions.size() + 1 > kMaxStates) {
+    return std::nullopt;
+  }
+
+  ShiftAndNFSA bits;
+  bits.size_ = positions.size() + 1;
+  bits.chunks_ = (bits.size_ + kChunkBits - 1) / kChunkBits;
+
+  // Positions grouped by the NFA state they stand for.
+  std::vector<std::vector<std::size_t>> copies(nfa.Size());
+  copies[nfa.Start()].push_back(0);
+  std::size_t next_bit = 1;
+  for (auto& [key, bit] : positions) {
+    bit = next_bit++;
+    copies[key.first].push_back(bit);
+    Set(bits.symbol_masks_[key.second], bit);
+  }
+
+  Set(bits.start_, 0);
+  std::vector<Mask> follow(bits.size_);
+  for (std::size_t node = 0; node < nfa.Size(); ++node) {
+    Mask succ = {};
+    for (const auto& edge : nfa.Transitions(node)) {
+      Set(succ, positions.at({edge.to, edge.symbol}));
+    }
+    for (std::size_t bit : copies[node]) {
+      follow[bit] = succ;
+      if (nfa.IsFinite(node)) {
+        Set(bits.finite_, bit);
+      }
+    }
+  }
+
+  bits.follow_.assign(bits.chunks_ * kChunkSize, Mask{});
+  for (std::size_t chunk = 0; chunk < bits.chunks_; ++chunk) {
+    Mask* table = bits.follow_.data() + chunk * kChunkSize;
+    for (std::size_t pattern = 1; pattern < kChunkSize; ++pattern) {
+      std::size_t bit = chunk * kChunkBits + std::countr_zero(pattern);
+      table[pattern] = table[pattern & (pattern - 1)];
+      if (bit < bits.size_) {
+        Or(table[pattern], follow[bit]);
+      }
+    }
+  }
+  return bits;
+}
+
+template <typename Alphabet, std::size_t kWords>
+std::size_t ShiftAndNFSA<Alphabet, kWords>::MaxMatch(
+    std::basic_string_view<CharT> sv) const {
+  Mask state = start_;
+  std::size_t ans = kNoMatch;
+  for (std::size_t i = 0;; ++i) {
+    Mask accepted = state;
+    for (std::size_t w = 0; w < kWords; ++w) {
+      accepted[w] &= finite_[w];
+    }
+    if (Any(accepted)) ans = i;
+    if (i == sv.length()) return ans;
+
+    uint64_t via = Alphabet::Ord(sv[i]);
+    if (via >= Alphabet::kSize) return ans;
+
+    Mask next = Follow(state);
+    for (std::size_t w = 0; w < kWords; ++w) {
+      next[w] &= symbol_masks_[via][w];
+    }
+    if (!Any(next)) return ans;
+    state = next;
+  }
+}
+
+}  // namespace rgx
+
+#endif /* REGEX_SHIFT_AND_HPP */
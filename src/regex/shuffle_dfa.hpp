@@ -0,0 +1,183 @@
+#ifndef REGEX_SHUFFLE_DFA_HPP
+#define REGEX_SHUFFLE_DFA_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REGEX_SHUFFLE_DFA_SSSE3 1
+#endif
+
+#include "fdfa.hpp"
+#include "frozen_dfa.hpp"
+
+namespace rgx {
+
+/*
+ * DFA with at most 16 states over a byte alphabet, matched with byte
+ * shuffles.
+ *
+ * For every input byte, tables_[byte] maps each of the 16 states to its
+ * successor. FullMatch runs the input from all states at once: a vector of
+ * 16 lanes, lane i holding where state i has got to, takes one PSHUFB per
+ * byte. That makes chunks of the input independent, so four chunks are
+ * simulated side by side and their maps composed at the end.
+ *
+ * The SSSE3 kernel is chosen at run time; other machines use the same
+ * tables one lane at a time.
+ */
+template <typename Alphabet>
+class ShuffleDFA {
+  using CharT = typename Alphabet::CharT;
+  static_assert(sizeof(CharT) == 1, "Tables are indexed by bytes");
+
+ public:
+  using State = uint8_t;
+  static const constexpr size_t kMaxStates = 16;
+  static const constexpr State kDead = 0;
+  static const constexpr size_t kNoMatch = ~0ul;
+
+ private:
+  using Map = std::array<State, kMaxStates>;
+
+  static const constexpr size_t kChunks = 4;
+  // Inputs shorter than this aren't worth splitting.
+  static const constexpr size_t kMinChunk = 64;
+
+  alignas(16) std::array<Map, 256> tables_ = {};
+  uint16_t finite_ = 0;  // Bit per state.
+  State start_ = kDead;
+  size_t size_ = 1;
+
+  ShuffleDFA() = default;
+
+  const Map& Table(CharT chr) const {
+    return tables_[static_cast<unsigned char>(chr)];
+  }
+
+  bool FullMatchScalar(std::basic_string_view<CharT> sv) const {
+    State state = start_;
+    for (CharT chr : sv) {
+      state = Table(chr)[state];
+    }
+    return (finite_ >> state) & 1;
+  }
+
+#ifdef REGEX_SHUFFLE_DFA_SSSE3
+  static bool HasSsse3() {
+    static const bool kHasSsse3 = __builtin_cpu_supports("ssse3");
+    return kHasSsse3;
+  }
+
+  __attribute__((target("ssse3"))) bool FullMatchSsse3(
+      std::basic_string_view<CharT> sv) const {
+    const auto* tables = reinterpret_cast<const __m128i*>(tables_.data());
+    auto table = [tables](CharT chr) {
+      return _mm_load_si128(tables + static_cast<unsigned char>(chr));
+    };
+    const __m128i identity =
+        _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i dead = _mm_setzero_si128();
+    auto all_dead = [dead](__m128i map) {
+      return _mm_movemask_epi8(_mm_cmpeq_epi8(map, dead)) == 0xffff;
+    };
+
+    size_t chunk = sv.length() / kChunks;
+    __m128i maps[kChunks];
+    std::fill(maps, maps + kChunks, identity);
+    for (size_t i = 0; i < chunk;) {
+      // Dead is absorbing, so once some chunk maps every state to it the
+      // input can't match. Checked every kMinChunk bytes.
+      for (size_t end = std::min(chunk, i + kMinChunk); i < end; ++i) {
+        for (size_t c = 0; c < kChunks; ++c) {
+          maps[c] = _mm_shuffle_epi8(table(sv[c * chunk + i]), maps[c]);
+        }
+      }
+      for (size_t c = 0; c < kChunks; ++c) {
+        if (all_dead(maps[c])) return false;
+      }
+    }
+    for (size_t i = kChunks * chunk; i < sv.length(); ++i) {
+      maps[kChunks - 1] = _mm_shuffle_epi8(table(sv[i]), maps[kChunks - 1]);
+    }
+
+    // Lane i of the composition is where the whole input leads state i.
+    __m128i map = maps[0];
+    for (size_t c = 1; c < kChunks; ++c) {
+      map = _mm_shuffle_epi8(maps[c], map);
+    }
+    alignas(16) Map lanes;
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes.data()), map);
+    return (finite_ >> lanes[start_]) & 1;
+  }
+#endif
+
+ public:
+  // Fails if `dfa` has more than kMaxStates states, counting kDead.
+  template <typename StateT>
+  static std::optional<ShuffleDFA> FromFrozen(
+      const FrozenFDFA<Alphabet, StateT>& dfa) {
+    if (dfa.Size() > kMaxStates) {
+      return std::nullopt;
+    }
+    // Frozen state ids are row offsets, rows are NumClasses() apart.
+    size_t stride = dfa.NumClasses();
+    ShuffleDFA shuffle;
+    shuffle.size_ = dfa.Size();
+    shuffle.start_ = dfa.Start() / stride;
+    for (size_t row = 0; row < dfa.Size(); ++row) {
+      if (dfa.IsFinite(row * stride)) {
+        shuffle.finite_ |= 1u << row;
+      }
+      for (size_t byte = 0; byte < 256; ++byte) {
+        auto to = dfa.Next(row * stride, static_cast<CharT>(byte));
+        shuffle.tables_[byte][row] = to / stride;
+      }
+    }
+    return shuffle;
+  }
+
+  template <typename Node>
+  static std::optional<ShuffleDFA> FromFDFA(const FDFA<Alphabet, Node>& fdfa) {
+    return FromFrozen(FrozenFDFA<Alphabet>(fdfa));
+  }
+
+  size_t Size() const { return size_; }
+
+  State Start() const { return start_; }
+
+  bool IsFinite(State state) const { return (finite_ >> state) & 1; }
+
+  State Next(State from, CharT chr) const { return Table(chr)[from]; }
+
+  // Whether all of `sv` is in the language.
+  bool FullMatch(std::basic_string_view<CharT> sv) const {
+#ifdef REGEX_SHUFFLE_DFA_SSSE3
+    if (sv.length() >= kChunks * kMinChunk && HasSsse3()) {
+      return FullMatchSsse3(sv);
+    }
+#endif
+    return FullMatchScalar(sv);
+  }
+
+  // Length of the longest prefix of `sv` in the language, or kNoMatch. Runs
+  // one state at a time, the tables are small enough to stay in L1.
+  size_t MaxMatch(std::basic_string_view<CharT> sv) const {
+    State state = start_;
+    size_t ans = IsFinite(state) ? 0 : kNoMatch;
+    for (size_t i = 0; i < sv.length() && state != kDead; ++i) {
+      state = Table(sv[i])[state];
+      if (IsFinite(state)) ans = i + 1;
+    }
+    return ans;
+  }
+};
+
+}  // namespace rgx
+
+#endif /* REGEX_SHUFFLE_DFA_HPP */
@@ -0,0 +1,110 @@
+#ifndef REGEX_SUBSET_TABLE_HPP
+#define REGEX_SUBSET_TABLE_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace rgx {
+
+/*
+ * Interning table for sorted sets of NFA states, used by the subset
+ * construction. Sets are stored back to back in one arena and found through
+ * an open addressing hash table, so looking a set up costs one hash and
+ * usually one comparison.
+ */
+template <typename Node>
+class SubsetTable {
+  static const constexpr size_t kEmptySlot = ~0ul;
+  static const constexpr size_t kMinSlots = 16;
+
+  std::vector<Node> arena_;
+  std::vector<size_t> offsets_ = {0};
+  std::vector<uint64_t> hashes_;
+  std::vector<size_t> slots_ = std::vector<size_t>(kMinSlots, kEmptySlot);
+
+  static uint64_t Hash(std::span<const Node> subset) {
+    uint64_t hash = subset.size();
+    for (Node node : subset) {
+      hash = (hash ^ static_cast<uint64_t>(node)) * 0x9e3779b97f4a7c15ul;
+      hash ^= hash >> 29;
+    }
+    return hash;
+  }
+
+  size_t FindSlot(std::span<const Node> subset, uint64_t hash) const {
+    size_t mask = slots_.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+      size_t id = slots_[slot];
+      if (id == kEmptySlot) {
+        return slot;
+      }
+      if (hashes_[id] == hash && std::ranges::equal((*this)[id], subset)) {
+        return slot;
+      }
+    }
+  }
+
+  void Grow() {
+    slots_.assign(slots_.size() * 2, kEmptySlot);
+    size_t mask = slots_.size() - 1;
+    for (size_t id = 0; id < Size(); ++id) {
+      size_t slot = hashes_[id] & mask;
+      while (slots_[slot] != kEmptySlot) {
+        slot = (slot + 1) & mask;
+      }
+      slots_[slot] = id;
+    }
+  }
+
+ public:
+  size_t Size() const { return hashes_.size(); }
+
+  std::span<const Node> operator[](size_t id) const {
+    assert(id < Size());
+    return {arena_.data() + offsets_[id], arena_.data() + offsets_[id + 1]};
+  }
+
+  // `subset` must be sorted and free of duplicates. Returns the id of the set
+  // and whether it was added by this call. Ids are dense and never change.
+  std::pair<size_t, bool> Intern(std::span<const Node> subset) {
+    assert(std::is_sorted(subset.begin(), subset.end()));
+    uint64_t hash = Hash(subset);
+    size_t slot = FindSlot(subset, hash);
+    if (slots_[slot] != kEmptySlot) {
+      return {slots_[slot], false};
+    }
+
+    size_t id = Size();
+    arena_.insert(arena_.end(), subset.begin(), subset.end());
+    offsets_.push_back(arena_.size());
+    hashes_.push_back(hash);
+    slots_[slot] = id;
+    if (Size() * 2 > slots_.size()) {
+      Grow();
+    }
+    return {id, true};
+  }
+
+  void Clear() {
+    arena_.clear();
+    offsets_.assign(1, 0);
+    hashes_.clear();
+    slots_.assign(kMinSlots, kEmptySlot);
+  }
+
+  // Bytes taken by the stored sets. Capacity kept after Clear() isn't
+  // counted, it is reused by the next sets.
+  size_t MemoryUsage() const {
+    return arena_.size() * sizeof(Node) + offsets_.size() * sizeof(size_t) +
+           hashes_.size() * sizeof(uint64_t) + slots_.size() * sizeof(size_t);
+  }
+};
+
+}  // namespace rgx
+
+#endif /* REGEX_SUBSET_TABLE_HPP */
@@ -50,4 +50,8 @@ TEST(AlphabetChrTest, ALPH_ESCAPE_TEST) {
   ASSERT_TRUE(rgx::CharAlphabet::NeedEscape(')'));
   ASSERT_TRUE(rgx::CharAlphabet::NeedEscape('('));
   ASSERT_TRUE(rgx::CharAlphabet::NeedEscape('_'));
-}
\ No newline at end of file
+}
+TEST(AlphabetChrTest, ALPH_ORD_HIGH_TEST) {
+  ASSERT_EQ(rgx::CharAlphabet::Ord('\xff'), 255);
+  ASSERT_EQ(rgx::CharAlphabet::Chr(rgx::CharAlphabet::Ord('\x80')), '\x80');
+}
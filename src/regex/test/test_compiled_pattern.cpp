@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#include "../compiled_pattern.hpp"
+#include "alphabet.hpp"
+
+using namespace rgx;
+using Alphabet = SimpleAlphabet<2>;
+
+TEST(TEST_COMPILED_PATTERN, TEST_SAME_AS_NFSA) {
+  std::string wide;
+  for (size_t i = 0; i < 100; ++i) {
+    wide += "(a+b)";
+  }
+  std::string lazy = "(a+b)*a" + wide + wide + wide;
+  for (const std::string& rgx : {std::string("(ab+ba)*(_+a+ba)"), wide, lazy}) {
+    CompiledPattern<Alphabet> pattern{Regex<Alphabet>(rgx)};
+    ASSERT_EQ(pattern.NeedsScratch(), rgx == lazy);
+    auto nfa = GlushkovNFAFromRegex(Regex<Alphabet>(rgx)).Freeze();
+
+    CompiledPattern<Alphabet>::Scratch scratch;
+    for (const std::string& word :
+         {std::string("ab"), std::string(150, 'a'),
+          std::string(301, 'a') + "ba", std::string()}) {
+      ASSERT_EQ(pattern.MaxMatch(word, scratch), nfa.MaxMatch(word)) << word;
+      ASSERT_EQ(pattern.MaxMatch(word), nfa.MaxMatch(word)) << word;
+    }
+  }
+}
+
+TEST(TEST_COMPILED_PATTERN, TEST_SCRATCH_REUSE) {
+  std::string tail;
+  for (size_t i = 0; i < 300; ++i) {
+    tail += "(a+b)";
+  }
+  CompiledPattern<Alphabet> first{Regex<Alphabet>("(a+b)*a" + tail)};
+  CompiledPattern<Alphabet> second{Regex<Alphabet>("(a+b)*b" + tail)};
+  std::string word = "a" + std::string(300, 'b');
+
+  CompiledPattern<Alphabet>::Scratch scratch;
+  ASSERT_TRUE(first.Matches(word, scratch));
+  ASSERT_FALSE(second.Matches(word, scratch));
+  ASSERT_TRUE(first.Matches(word, scratch));
+  CompiledPattern<Alphabet> copy = second;
+  ASSERT_FALSE(copy.Matches(word, scratch));
+}
+
+TEST(TEST_COMPILED_PATTERN, TEST_THREADS) {
+  std::string rgx = "(a+b)*a";
+  for (size_t i = 0; i < 300; ++i) {
+    rgx += "(a+b)";
+  }
+  const CompiledPattern<Alphabet> pattern{Regex<Alphabet>(rgx)};
+  std::vector<size_t> found(4);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < found.size(); ++t) {
+    threads.emplace_back([&pattern, &found, t] {
+      CompiledPattern<Alphabet>::Scratch scratch;
+      std::string word(t, 'b');
+      for (size_t i = 0; i < 400; ++i) {
+        word += i % (t + 2) ? 'b' : 'a';
+        if (pattern.Matches(word, scratch)) {
+          ++found[t];
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  auto nfa = GlushkovNFAFromRegex(Regex<Alphabet>(rgx)).Freeze();
+  for (size_t t = 0; t < found.size(); ++t) {
+    size_t expected = 0;
+    std::string word(t, 'b');
+    for (size_t i = 0; i < 400; ++i) {
+      word += i % (t + 2) ? 'b' : 'a';
+      expected += nfa.MaxMatch(word) == word.size();
+    }
+    ASSERT_EQ(found[t], expected) << t;
+  }
+}
+
+TEST(TEST_COMPILED_PATTERN, TEST_POLISH_NOTATION) {
+  using Pattern = CompiledPattern<CanonicalAlphabet<3>>;
+  auto pattern = Pattern::FromReversePolishNotation("ab+*c.");
+  ASSERT_TRUE(pattern.has_value());
+  ASSERT_EQ(pattern->MaxMatch("ababaccaba"), 6);
+  ASSERT_FALSE(Pattern::FromReversePolishNotation("ab+*c").has_value());
+  ASSERT_EQ(MaxRegexMatch<CanonicalAlphabet<3>>("ab+*c", "c"),
+            Pattern::kNoMatch);
+}
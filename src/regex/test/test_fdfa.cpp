@@ -53,6 +53,8 @@ TEST(TEST_FDFA, TEST_INVERSE) {
   fdfa.SetTransition(0, 1, 1);
   auto fdfa2 = fdfa;
   fdfa2.Inverse();
+  ASSERT_TRUE(fdfa2.IsFinite(0));
+  ASSERT_FALSE(fdfa2.IsFinite(1));
   fdfa2.Inverse();
   std::stringstream ss1;
   fdfa.TextDump(ss1);
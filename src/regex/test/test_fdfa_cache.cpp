@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "../fdfa_cache.hpp"
+#include "alphabet.hpp"
+
+using namespace rgx;
+using Alphabet = SimpleAlphabet<3>;
+
+namespace {
+
+std::filesystem::path TempDir(const std::string& name) {
+  auto dir = std::filesystem::temp_directory_path() /
+             (name + std::to_string(std::random_device{}()));
+  std::filesystem::remove_all(dir);
+  return dir;
+}
+
+template <typename Node>
+std::string Dump(const FDFA<Alphabet, Node>& fdfa) {
+  std::stringstream ss;
+  fdfa.TextDump(ss);
+  return ss.str();
+}
+
+}  // namespace
+
+TEST(TEST_FDFA_CACHE, TEST_ROUND_TRIP) {
+  auto dir = TempDir("rgx_fdfa_cache");
+  FDFADiskCache<Alphabet> cache(dir);
+  std::string rgx = "(ab+ba)*(_+a+ba)c";
+  ASSERT_FALSE(cache.Load(rgx).has_value());
+
+  std::string expected = Dump(MDFAFromRegex(Regex<Alphabet>(rgx)));
+  ASSERT_EQ(Dump(cache.Get(rgx)), expected);
+  ASSERT_TRUE(std::filesystem::exists(cache.PathFor(rgx)));
+  ASSERT_EQ(std::distance(std::filesystem::directory_iterator(dir),
+                          std::filesystem::directory_iterator()),
+            1);
+
+  FDFADiskCache<Alphabet> restarted(dir);
+  auto loaded = restarted.Load(rgx);
+  ASSERT_TRUE(loaded.has_value());
+  ASSERT_EQ(Dump(*loaded), expected);
+  ASSERT_EQ(Dump(restarted.Get(rgx)), expected);
+
+  FDFADiskCache<Alphabet, uint8_t> narrow(dir);
+  ASSERT_NE(narrow.PathFor(rgx), cache.PathFor(rgx));
+  ASSERT_FALSE(narrow.Load(rgx).has_value());
+  ASSERT_EQ(Dump(narrow.Get(rgx)),
+            Dump(MDFAFromRegex<Alphabet, uint8_t>(Regex<Alphabet>(rgx))));
+  std::filesystem::remove_all(dir);
+}
+
+TEST(TEST_FDFA_CACHE, TEST_DAMAGED) {
+  auto dir = TempDir("rgx_fdfa_cache");
+  FDFADiskCache<Alphabet> cache(dir);
+  std::string rgx = "(a+b)*c";
+  std::string expected = Dump(cache.Get(rgx));
+  auto path = cache.PathFor(rgx);
+  auto size = std::filesystem::file_size(path);
+
+  std::filesystem::resize_file(path, size - 1);
+  ASSERT_FALSE(cache.Load(rgx).has_value());
+  ASSERT_EQ(Dump(cache.Get(rgx)), expected);
+  ASSERT_EQ(std::filesystem::file_size(path), size);
+
+  // A file left under this name by another pattern.
+  cache.Store("a*", MDFAFromRegex(Regex<Alphabet>("a*")));
+  std::filesystem::copy_file(cache.PathFor("a*"), path,
+                             std::filesystem::copy_options::overwrite_existing);
+  ASSERT_FALSE(cache.Load(rgx).has_value());
+  std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../fdfa_image.hpp"
+#include "../tranforms.hpp"
+#include "alphabet.hpp"
+
+using namespace rgx;
+
+namespace {
+
+// Image bytes in 8-byte aligned storage.
+template <typename Alphabet, typename Node>
+std::vector<uint64_t> Image(const FDFA<Alphabet, Node>& fdfa) {
+  std::stringstream ss;
+  WriteFDFAImage(ss, fdfa);
+  std::string bytes = ss.str();
+  std::vector<uint64_t> image((bytes.size() + 7) / 8);
+  std::memcpy(image.data(), bytes.data(), bytes.size());
+  return image;
+}
+
+std::span<const std::byte> Bytes(const std::vector<uint64_t>& image) {
+  return std::as_bytes(std::span(image));
+}
+
+template <typename Alphabet, typename Node>
+std::string Dump(const FDFA<Alphabet, Node>& fdfa) {
+  std::stringstream ss;
+  fdfa.TextDump(ss);
+  return ss.str();
+}
+
+}  // namespace
+
+TEST(TEST_FDFA_IMAGE, TEST_VIEW) {
+  std::string rgx = "(ab+ba)*(_+a+ba)";
+  auto nfa = GlushkovNFAFromRegex(Regex<CharAlphabet>(rgx));
+  auto fdfa = MDFAFromRegex<CharAlphabet, uint16_t>(Regex<CharAlphabet>(rgx));
+  auto image = Image(fdfa);
+
+  auto view = FDFAView<CharAlphabet, uint16_t>::FromBytes(Bytes(image));
+  ASSERT_TRUE(view.has_value());
+  ASSERT_EQ(view->Size(), fdfa.Size());
+  ASSERT_TRUE(view->CheckTable());
+  ASSERT_TRUE(view->Label().empty());
+  const auto* table =
+      reinterpret_cast<const std::byte*>(view->Transitions(0).data());
+  auto offset = table - Bytes(image).data();
+  ASSERT_EQ(offset % kImageAlignment, 0);
+  for (std::string word : {"", "a", "ab", "abba", "abbab", "abc", "ba\xff"}) {
+    ASSERT_EQ(view->MaxMatch(word), nfa.MaxMatch(word)) << word;
+  }
+  ASSERT_EQ(Dump(view->ToFDFA()), Dump(fdfa));
+}
+
+TEST(TEST_FDFA_IMAGE, TEST_REJECTED) {
+  using Alphabet = SimpleAlphabet<2>;
+  auto image = Image(MDFAFromRegex(Regex<Alphabet>("(a+b)*a")));
+  ASSERT_TRUE(FDFAView<Alphabet>::FromBytes(Bytes(image)).has_value());
+  ASSERT_FALSE((FDFAView<Alphabet, uint32_t>::FromBytes(Bytes(image))));
+  ASSERT_FALSE(FDFAView<SimpleAlphabet<3>>::FromBytes(Bytes(image)));
+  ASSERT_FALSE(FDFAView<Alphabet>::FromBytes(Bytes(image).first(100)));
+  ASSERT_FALSE(FDFAView<Alphabet>::FromBytes(Bytes(image).subspan(8)));
+
+  // Self-consistent headers of images that don't fit. With the first,
+  // unchecked arithmetic wraps image_size around to 8 bytes.
+  auto forged = image;
+  for (auto [states, label_length] :
+       {std::pair<uint64_t, uint32_t>{764631878702986587, 0},
+        {2, ~uint32_t{0}}}) {
+    auto header = details::ImageLayout<Alphabet, size_t>(states, label_length);
+    std::memcpy(forged.data(), &header, sizeof(header));
+    ASSERT_FALSE(FDFAView<Alphabet>::FromBytes(Bytes(forged))) << states;
+  }
+
+  // Damage the last transition.
+  image.back() = 77;
+  auto view = FDFAView<Alphabet>::FromBytes(Bytes(image));
+  ASSERT_TRUE(view.has_value());
+  ASSERT_FALSE(view->CheckTable());
+}
+
+TEST(TEST_FDFA_IMAGE, TEST_MAPPED) {
+  using Alphabet = SimpleAlphabet<2>;
+  auto path = std::filesystem::temp_directory_path() /
+              ("rgx_image" + std::to_string(std::random_device{}()));
+  auto fdfa = MDFAFromRegex(Regex<Alphabet>("(ab)*b?"));
+  const uint8_t kLabel[] = {1, 2, 3};
+  {
+    std::ofstream out(path, std::ios::binary);
+    WriteFDFAImage(out, fdfa, kLabel);
+  }
+
+  auto mapped = MappedFDFA<Alphabet>::Open(path);
+  std::filesystem::remove(path);
+  ASSERT_TRUE(mapped.has_value());
+  ASSERT_TRUE(std::ranges::equal(mapped->View().Label(), kLabel));
+  ASSERT_EQ(mapped->View().MaxMatch("ababba"), 5);
+  ASSERT_EQ(Dump(mapped->View().ToFDFA()), Dump(fdfa));
+  ASSERT_FALSE(MappedFDFA<Alphabet>::Open(path).has_value());
+}
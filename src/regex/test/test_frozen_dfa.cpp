@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+
+#include "../frozen_dfa.hpp"
+#include "../tranforms.hpp"
+#include "alphabet.hpp"
+
+using namespace rgx;
+
+TEST(TEST_FROZEN_FDFA, TEST_CLASSES) {
+  std::string rgx = "(ab+ba)*(_+a+ba)";
+  auto nfa = GlushkovNFAFromRegex(Regex<CharAlphabet>(rgx));
+  auto fdfa = MDFAFromRegex(Regex<CharAlphabet>(rgx));
+  FrozenFDFA<CharAlphabet> dfa(fdfa);
+
+  ASSERT_EQ(dfa.NumClasses(), 3);
+  ASSERT_NE(dfa.ClassOf('a'), dfa.ClassOf('b'));
+  ASSERT_EQ(dfa.ClassOf('c'), dfa.ClassOf('\xff'));
+  ASSERT_EQ(dfa.ClassOf('c'), dfa.ClassOf(0));
+  ASSERT_LT(dfa.Size(), fdfa.Size() + 1);
+  ASSERT_LT(dfa.MemoryUsage(), fdfa.Size() * CharAlphabet::kSize);
+
+  for (std::string word : {"", "a", "ab", "abba", "abbab", "abc", "ba\xff",
+                           "bababababa", "bb"}) {
+    ASSERT_EQ(dfa.MaxMatch(word), nfa.MaxMatch(word)) << word;
+  }
+}
+
+TEST(TEST_FROZEN_FDFA, TEST_DEAD) {
+  using Alphabet = SimpleAlphabet<2>;
+  FDFA<Alphabet> fdfa;
+  fdfa.CreateNode();
+  fdfa.CreateNode();
+  fdfa.SetTransition(0, 1, 1);
+  fdfa.SetTransition(0, 2, 2);
+  fdfa.SetTransition(2, 1, 2);
+  fdfa.MakeFinite(1);
+
+  FrozenFDFA<Alphabet> dfa(fdfa);
+  ASSERT_EQ(dfa.Size(), 3);
+  ASSERT_EQ(dfa.Next(dfa.Start(), 'b'), FrozenFDFA<Alphabet>::kDead);
+  ASSERT_EQ(dfa.Next(dfa.Start(), 'z'), FrozenFDFA<Alphabet>::kDead);
+  ASSERT_TRUE(dfa.IsFinite(dfa.Next(dfa.Start(), 'a')));
+  ASSERT_EQ(dfa.MaxMatch("ab"), 1);
+  ASSERT_EQ(dfa.MaxMatch("ba"), FrozenFDFA<Alphabet>::kNoMatch);
+
+  FrozenFDFA<Alphabet> empty(FDFA<Alphabet>{});
+  ASSERT_EQ(empty.Start(), FrozenFDFA<Alphabet>::kDead);
+  ASSERT_EQ(empty.MaxMatch("a"), FrozenFDFA<Alphabet>::kNoMatch);
+}
+
+TEST(TEST_FROZEN_FDFA, TEST_NARROW_STATES) {
+  std::string rgx = "(a+b)*a(a+b)(a+b)(a+b)(a+b)";
+  auto fdfa = MDFAFromRegex(Regex<CharAlphabet>(rgx));
+  ASSERT_TRUE((FrozenFDFA<CharAlphabet, uint16_t>::Fits(fdfa)));
+  // 512 live states and a sink, but only three classes: 513 rows of 3.
+  auto big = MDFAFromRegex(Regex<CharAlphabet>(rgx + "(a+b)(a+b)(a+b)(a+b)"));
+  ASSERT_EQ(big.Size(), 513);
+  ASSERT_TRUE((FrozenFDFA<CharAlphabet, uint16_t>::Fits(big)));
+  ASSERT_FALSE((FrozenFDFA<CharAlphabet, uint8_t>::Fits(big)));
+  ASSERT_THROW((FrozenFDFA<CharAlphabet, uint8_t>(big)), std::length_error);
+  ASSERT_EQ((FrozenFDFA<CharAlphabet, uint16_t>(big).NumClasses()), 3);
+  FrozenFDFA<CharAlphabet> wide(fdfa);
+  FrozenFDFA<CharAlphabet, uint16_t> narrow(fdfa);
+  ASSERT_EQ(narrow.Size(), wide.Size());
+  ASSERT_LT(narrow.MemoryUsage(), wide.MemoryUsage());
+
+  for (std::string word : {"", "aaaaa", "abbbb", "babab", "bbaab", "abab"}) {
+    ASSERT_EQ(narrow.MaxMatch(word), wide.MaxMatch(word)) << word;
+  }
+}
+
+TEST(TEST_FROZEN_FDFA, TEST_ENTRY_POINTS) {
+  using Alphabet = SimpleAlphabet<2>;
+  for (std::string rgx : {"(ab+ba)*(_+a+ba)", "(a+b)*a(a+b)(a+b)", "aaaa*b",
+                          "(a+b)*", "_"}) {
+    auto nfa = GlushkovNFAFromRegex(Regex<Alphabet>(rgx));
+    FrozenFDFA<Alphabet> dfa(MDFAFromRegex(Regex<Alphabet>(rgx)));
+    FrozenFDFA<Alphabet, uint8_t> narrow(MDFAFromRegex(Regex<Alphabet>(rgx)));
+
+    std::vector<std::string> words = {"", "abz"};
+    for (size_t i = 0; i < words.size() && words[i].size() < 9; ++i) {
+      words.push_back(words[i] + 'a');
+      words.push_back(words[i] + 'b');
+    }
+    for (const std::string& word : words) {
+      size_t expected = nfa.MaxMatch(word);
+      ASSERT_EQ(dfa.MaxMatch(word), expected) << rgx << ' ' << word;
+      ASSERT_EQ(narrow.MaxMatch(word), expected) << rgx << ' ' << word;
+      ASSERT_EQ(dfa.FullMatch(word), expected == word.size()) << word;
+      ASSERT_EQ(dfa.AnyMatch(word), expected != FrozenFDFA<Alphabet>::kNoMatch)
+          << rgx << ' ' << word;
+    }
+  }
+}
+
+TEST(TEST_FROZEN_FDFA, TEST_MATCH_MANY) {
+  using Alphabet = SimpleAlphabet<2>;
+  for (std::string rgx : {"(ab+ba)*(_+a+ba)", "(a+b)*a(a+b)(a+b)", "aaaa*b",
+                          "(a+b)*", "_", "bbbbbbbbbbbbb*"}) {
+    FrozenFDFA<Alphabet> dfa(MDFAFromRegex(Regex<Alphabet>(rgx)));
+
+    // Lengths vary so lanes finish and refill at different times.
+    std::vector<std::string> words = {"", "abz", "z"};
+    for (size_t i = 0; i < words.size() && words[i].size() < 8; ++i) {
+      words.push_back(words[i] + 'a');
+      words.push_back(words[i] + 'b');
+      words.push_back(words[i] + words[i] + "ab");
+    }
+    std::vector<std::string_view> inputs(words.begin(), words.end());
+    std::vector<size_t> results(inputs.size() + 1, 42);
+    dfa.MaxMatchMany(inputs, results);
+    for (size_t i = 0; i < words.size(); ++i) {
+      ASSERT_EQ(results[i], dfa.MaxMatch(words[i])) << rgx << ' ' << words[i];
+    }
+    ASSERT_EQ(results.back(), 42);
+
+    dfa.MaxMatchMany({}, {});
+  }
+}
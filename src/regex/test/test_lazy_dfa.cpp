@@ -0,0 +1,42 @@
+#include <gtest/gtest.h>
+
+#include "../lazy_dfa.hpp"
+#include "../tranforms.hpp"
+#include "alphabet.hpp"
+
+using namespace rgx;
+using Alphabet = SimpleAlphabet<2>;
+
+TEST(TEST_LAZY_DFA, TEST_SAME_AS_NFSA) {
+  auto nfa = GlushkovNFAFromRegex(Regex<Alphabet>("(a+b)*a(a+b)(a+b)b*"))
+                 .Freeze();
+  LazyDFA<Alphabet> dfa(nfa);
+  for (std::string word : {"", "a", "aab", "abab", "bbbbabbbbbc", "aaaaaaa"}) {
+    ASSERT_EQ(dfa.MaxMatch(word), nfa.MaxMatch(word)) << word;
+  }
+  ASSERT_EQ(dfa.Stats().flushes, 0);
+
+  size_t misses = dfa.Stats().misses;
+  ASSERT_EQ(dfa.MaxMatch("abab"), 4);
+  ASSERT_EQ(dfa.Stats().misses, misses);
+  ASSERT_GE(dfa.Stats().hits, 4);
+}
+
+TEST(TEST_LAZY_DFA, TEST_FLUSH) {
+  std::string rgx = "(a+b)*a";
+  for (size_t i = 0; i < 10; ++i) {
+    rgx += "(a+b)";
+  }
+  auto nfa = GlushkovNFAFromRegex(Regex<Alphabet>(rgx)).Freeze();
+  LazyDFA<Alphabet> dfa(nfa, 4096);
+
+  std::string word;
+  uint64_t seed = 1;
+  for (size_t i = 0; i < 500; ++i) {
+    seed = seed * 6364136223846793005ul + 1442695040888963407ul;
+    word += (seed >> 62) & 1 ? 'a' : 'b';
+  }
+  ASSERT_EQ(dfa.MaxMatch(word), nfa.MaxMatch(word));
+  ASSERT_GT(dfa.Stats().flushes, 0);
+  ASSERT_LE(dfa.MemoryUsage(), 4096);
+}
@@ -118,3 +118,150 @@ TEST_F(TEST_NFAFixtures, TEST_ALTERNATE) {
   TEST_NFAFixtures::nfsa1.TextDump(ss);
   ASSERT_EQ(ss.str(), ans);
 }
+
+TEST(TEST_NFSA, TEST_FREEZE) {
+  NFSA<Alphabet> nfsa;
+  auto node1 = nfsa.CreateNode();
+  auto node2 = nfsa.CreateNode();
+  nfsa.AddTransition(nfsa.Start(), 2, node2);
+  nfsa.AddTransition(nfsa.Start(), 1, node2);
+  nfsa.AddTransition(nfsa.Start(), 1, node1);
+  nfsa.AddTransition(node1, 2, node2);
+  nfsa.MakeFinite(node2);
+
+  auto frozen = nfsa.Freeze();
+  ASSERT_EQ(frozen.Size(), 3);
+  ASSERT_EQ(frozen.EdgesCount(), 4);
+  ASSERT_FALSE(frozen.IsAnyEpsilon());
+  ASSERT_TRUE(frozen.IsFinite(node2));
+  ASSERT_FALSE(frozen.IsFinite(node1));
+
+  auto via_a = frozen.Transitions(frozen.Start(), 1);
+  ASSERT_EQ(via_a.size(), 2);
+  ASSERT_EQ(via_a[0].to, node1);
+  ASSERT_EQ(via_a[1].to, node2);
+  ASSERT_EQ(frozen.Transitions(frozen.Start(), 2).size(), 1);
+  ASSERT_EQ(frozen.Transitions(node2).size(), 0);
+
+  ASSERT_EQ(frozen.MaxMatch("ab"), 2);
+  ASSERT_EQ(frozen.MaxMatch("abb"), 2);
+  ASSERT_EQ(frozen.MaxMatch("b"), 1);
+  ASSERT_EQ(frozen.MaxMatch("ba"), 1);
+  ASSERT_EQ(frozen.MaxMatch(""), NFSA<Alphabet>::kNoMatch);
+  ASSERT_EQ(frozen.MaxMatch("c"), NFSA<Alphabet>::kNoMatch);
+  ASSERT_EQ(nfsa.MaxMatch("ab"), 2);
+}
+
+TEST(TEST_NFSA, TEST_EPSILON_CYCLES) {
+  uint64_t seed = 7;
+  auto random = [&seed](uint64_t bound) {
+    seed = seed * 6364136223846793005ul + 1442695040888963407ul;
+    return (seed >> 33) % bound;
+  };
+
+  for (size_t round = 0; round < 50; ++round) {
+    NFSA<Alphabet> nfsa;
+    const size_t kNodes = 12;
+    while (nfsa.Size() < kNodes) {
+      nfsa.CreateNode();
+    }
+    for (size_t i = 0; i < 30; ++i) {
+      size_t from = random(kNodes);
+      size_t to = random(kNodes);
+      uint64_t via = random(Alphabet::kSize);
+      if (!nfsa.HasTransition(from, via, to)) {
+        nfsa.AddTransition(from, via, to);
+      }
+    }
+    nfsa.MakeFinite(random(kNodes));
+    auto frozen = nfsa.Freeze();
+
+    // Subsets as bit masks, closed under epsilon by iterating to a fixpoint.
+    auto close = [&frozen](uint64_t set) {
+      for (uint64_t prev = 0; prev != set;) {
+        prev = set;
+        for (size_t node = 0; node < kNodes; ++node) {
+          if (prev >> node & 1) {
+            for (const auto& edge : frozen.Transitions(node, 0)) {
+              set |= uint64_t{1} << edge.to;
+            }
+          }
+        }
+      }
+      return set;
+    };
+    auto max_match = [&](const std::string& word) {
+      uint64_t set = close(uint64_t{1} << frozen.Start());
+      size_t ans = NFSA<Alphabet>::kNoMatch;
+      for (size_t i = 0;; ++i) {
+        for (size_t node = 0; node < kNodes; ++node) {
+          if ((set >> node & 1) && frozen.IsFinite(node)) ans = i;
+        }
+        if (i == word.size() || set == 0) return ans;
+        uint64_t next = 0;
+        for (size_t node = 0; node < kNodes; ++node) {
+          if (set >> node & 1) {
+            for (const auto& edge :
+                 frozen.Transitions(node, Alphabet::Ord(word[i]))) {
+              next |= uint64_t{1} << edge.to;
+            }
+          }
+        }
+        set = close(next);
+      }
+    };
+
+    nfsa.RemoveEpsilonTransitions();
+    ASSERT_FALSE(nfsa.Freeze().IsAnyEpsilon());
+    std::vector<std::string> words = {""};
+    for (size_t i = 0; i < words.size() && words[i].size() < 5; ++i) {
+      words.push_back(words[i] + 'a');
+      words.push_back(words[i] + 'b');
+    }
+    for (const std::string& word : words) {
+      ASSERT_EQ(nfsa.MaxMatch(word), max_match(word)) << round << ' ' << word;
+    }
+  }
+}
+
+TEST(TEST_NFSA, TEST_TRIM) {
+  NFSA<Alphabet> nfsa;
+  while (nfsa.Size() < 6) {
+    nfsa.CreateNode();
+  }
+  nfsa.SetStart(1);
+  nfsa.AddTransition(1, 1, 3);  // 3 is dead.
+  nfsa.AddTransition(1, 2, 4);
+  nfsa.AddTransition(4, 1, 4);
+  nfsa.AddTransition(0, 1, 4);  // 0 and 5 are unreachable.
+  nfsa.AddTransition(5, 2, 1);
+  nfsa.MakeFinite(4);
+  nfsa.MakeFinite(5);
+
+  nfsa.Trim();
+  std::stringstream ss;
+  nfsa.TextDump(ss);
+  ASSERT_EQ(ss.str(), "0\n\n1\n\n0 1 b\n1 1 a\n\n");
+  ASSERT_EQ(nfsa.MaxMatch("baab"), 3);
+
+  nfsa.RemoveFinite(1);
+  nfsa.Trim();
+  ASSERT_EQ(nfsa.Size(), 1);
+  ASSERT_EQ(nfsa.MaxMatch("b"), NFSA<Alphabet>::kNoMatch);
+}
+
+TEST(TEST_NFSA, TEST_TRIM_LONG) {
+  NFSA<Alphabet> nfsa;
+  const size_t length = 1000000;
+  auto node = nfsa.Start();
+  for (size_t i = 0; i < length; ++i) {
+    auto next = nfsa.CreateNode();
+    nfsa.AddTransition(node, 1, next);
+    nfsa.AddTransition(node, 2, nfsa.CreateNode());
+    node = next;
+  }
+  nfsa.MakeFinite(node);
+  nfsa.Trim();
+  ASSERT_EQ(nfsa.Size(), length + 1);
+  ASSERT_EQ(nfsa.Freeze().EdgesCount(), length);
+}
@@ -0,0 +1,37 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+
+#include "../parallel_match.hpp"
+#include "../tranforms.hpp"
+#include "alphabet.hpp"
+
+using namespace rgx;
+using Alphabet = SimpleAlphabet<2>;
+
+TEST(TEST_PARALLEL_MATCH, TEST_SAME_AS_SERIAL) {
+  ThreadPool pool(4);
+  std::mt19937 rng(7);
+  for (std::string rgx : {"(a+b)*a(a+b)(a+b)", "((a+b)(a+b)(a+b))*",
+                          "(ab+ba)*(_+a+ba)", "(a+b)*", "a*b"}) {
+    FrozenFDFA<Alphabet> dfa(MDFAFromRegex(Regex<Alphabet>(rgx)));
+    for (size_t length : {0, 10, 300000, 1000001}) {
+      std::string word(length, 'a');
+      for (char& chr : word) {
+        chr = "ab"[rng() % 2];
+      }
+      ASSERT_EQ(ParallelFullMatch(dfa, word, pool), dfa.FullMatch(word))
+          << rgx << ' ' << length;
+      ASSERT_EQ(ParallelMaxMatch(dfa, word, pool), dfa.MaxMatch(word))
+          << rgx << ' ' << length;
+      if (length > 0) {
+        // Out of the alphabet, kills every run.
+        word[length / 2] = 'z';
+        ASSERT_EQ(ParallelFullMatch(dfa, word, pool), false) << rgx;
+        ASSERT_EQ(ParallelMaxMatch(dfa, word, pool), dfa.MaxMatch(word))
+            << rgx << ' ' << length;
+      }
+    }
+  }
+}
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../pattern_cache.hpp"
+#include "alphabet.hpp"
+
+using namespace rgx;
+using Alphabet = SimpleAlphabet<3>;
+
+TEST(TEST_PATTERN_CACHE, TEST_HITS) {
+  PatternCache<Alphabet> cache;
+  auto first = cache.Get("(a+b)*c");
+  ASSERT_NE(first, nullptr);
+  ASSERT_EQ(cache.Get("(a+b)*c"), first);
+  ASSERT_NE(cache.Get("ab+*c$", Notation::ReversePolish), first);
+  ASSERT_EQ(cache.Get("$*+abc", Notation::Polish)->MaxMatch("abbcc"), 4);
+
+  ASSERT_EQ(cache.Get("(a+"), nullptr);
+  ASSERT_EQ(cache.Get("ab", Notation::Polish), nullptr);
+  ASSERT_EQ(cache.Size(), 3);
+  ASSERT_EQ(cache.Stats().hits, 1);
+  ASSERT_EQ(cache.Stats().misses, 5);
+  ASSERT_EQ(cache.Stats().evictions, 0);
+}
+
+TEST(TEST_PATTERN_CACHE, TEST_LRU) {
+  size_t size = PatternCache<Alphabet>().Get("a*b")->MemoryUsage() + 3;
+  PatternCache<Alphabet> cache(2 * size);
+  auto a = cache.Get("a*b");
+  cache.Get("b*a");
+  ASSERT_EQ(cache.Get("a*b"), a);
+  cache.Get("c*a");
+  ASSERT_EQ(cache.Size(), 2);
+  ASSERT_EQ(cache.Stats().evictions, 1);
+  ASSERT_LE(cache.MemoryUsage(), 2 * size);
+
+  ASSERT_EQ(cache.Get("a*b"), a);
+  cache.Get("b*a");
+  ASSERT_EQ(cache.Stats().misses, 4);
+  ASSERT_EQ(cache.Stats().evictions, 2);
+  ASSERT_TRUE(a->Matches("aab"));
+
+  std::string huge;
+  for (size_t i = 0; i < 100; ++i) {
+    huge += "(a+b)";
+  }
+  ASSERT_NE(cache.Get(huge), nullptr);
+  ASSERT_EQ(cache.Size(), 2);
+}
+
+TEST(TEST_PATTERN_CACHE, TEST_THREADS) {
+  PatternCache<Alphabet> cache;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&cache] {
+      for (size_t i = 0; i < 200; ++i) {
+        std::string rgx = "(a+b)*" + std::string(i % 10 + 1, 'c');
+        ASSERT_TRUE(cache.Get(rgx)->Matches("ab" + rgx.substr(6)));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(cache.Size(), 10);
+  ASSERT_EQ(cache.Stats().hits + cache.Stats().misses, 800);
+}
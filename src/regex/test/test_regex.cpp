@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 
+#include <memory>
+#include <unordered_set>
+
 #include "../regex.hpp"
 #include "alphabet.hpp"
 
@@ -22,7 +25,8 @@ TEST(REGEX_TEST, RECREATION) {
   auto regex_copy = regex;
   regex_copy.Optional();
   ASSERT_NE(regex_copy, regex);
-  ss << *mgk::Cast<rgx::RegexQuantified<rgx::CharAlphabet>>(r);
+  ASSERT_EQ(r->GetKind(), rgx::RegexImpl<rgx::CharAlphabet>::RK_Optional);
+  ss << *r;
 }
 
 TEST(REGEX_TEST, RECREATION2) {
@@ -43,12 +47,15 @@ TEST(REGEX_TEST, RECREATION2) {
 
   const rgx::RegexImpl<rgx::SimpleAlphabet<2>>* r =
       rgx::RegexImpl<rgx::SimpleAlphabet<2>>::FromString("(a+bb*(ab+b))?");
-  ss << *mgk::Cast<rgx::RegexQuantified<rgx::SimpleAlphabet<2>>>(r);
+  ASSERT_EQ(r->GetKind(), rgx::RegexImpl<rgx::SimpleAlphabet<2>>::RK_Optional);
+  ss << *r;
   r = rgx::RegexImpl<rgx::SimpleAlphabet<2>>::FromString("a+b?");
-  ss << *mgk::Cast<rgx::RegexAlternate<rgx::SimpleAlphabet<2>>>(r);
+  ASSERT_EQ(r->GetKind(), rgx::RegexImpl<rgx::SimpleAlphabet<2>>::RK_Alternate);
+  ss << *r;
   ;
   r = rgx::RegexImpl<rgx::SimpleAlphabet<2>>::FromString("a");
-  ss << *mgk::Cast<rgx::RegexLetter<rgx::SimpleAlphabet<2>>>(r);
+  ASSERT_EQ(r->GetKind(), rgx::RegexImpl<rgx::SimpleAlphabet<2>>::RK_Letter);
+  ss << *r;
   ;
 }
 
@@ -70,12 +77,187 @@ TEST(REGEX_TEST, RECREATION3) {
 
   const rgx::RegexImpl<rgx::CanonicalAlphabet<3>>* r =
       rgx::RegexImpl<rgx::CanonicalAlphabet<3>>::FromString("(a+bb*(ab+b))?");
-  ss << *mgk::Cast<rgx::RegexQuantified<rgx::CanonicalAlphabet<3>>>(r);
+  ASSERT_EQ(r->GetKind(),
+            rgx::RegexImpl<rgx::CanonicalAlphabet<3>>::RK_Optional);
+  ss << *r;
   r = rgx::RegexImpl<rgx::CanonicalAlphabet<3>>::FromString("a+b?");
-  ss << *mgk::Cast<rgx::RegexAlternate<rgx::CanonicalAlphabet<3>>>(r);
+  ASSERT_EQ(r->GetKind(),
+            rgx::RegexImpl<rgx::CanonicalAlphabet<3>>::RK_Alternate);
+  ss << *r;
   r = rgx::RegexImpl<rgx::CanonicalAlphabet<3>>::FromString("a");
-  ss << *mgk::Cast<rgx::RegexLetter<rgx::CanonicalAlphabet<3>>>(r);
+  ASSERT_EQ(r->GetKind(), rgx::RegexImpl<rgx::CanonicalAlphabet<3>>::RK_Letter);
+  ss << *r;
 
   auto r1 = regex.Kleene().Optional().Reverse();
 
 }
+
+TEST(REGEX_TEST, ARENA) {
+  using Alphabet = rgx::SimpleAlphabet<2>;
+  using Impl = rgx::RegexImpl<Alphabet>;
+
+  auto regex = rgx::Regex<Alphabet>("(ab+b)*a?");
+  const Impl* impl = regex.GetImpl();
+  ASSERT_EQ(impl->Size(), 7);  // 'a' and 'b' are shared.
+  ASSERT_EQ(impl->GetKind(), Impl::RK_Concatenate);
+  auto subs = impl->GetSubregex(impl->Root());
+  ASSERT_EQ(subs.size(), 2);
+  ASSERT_EQ(impl->GetKind(subs[0]), Impl::RK_Kleene);
+  ASSERT_EQ(impl->GetKind(subs[1]), Impl::RK_Optional);
+  auto letter = impl->GetSubregex(subs[1])[0];
+  ASSERT_EQ(impl->GetLetterChr(letter), 'a');
+
+  ASSERT_EQ(Impl::FromString("(a+b"), nullptr);
+
+  auto copy = regex;
+  copy.Concat(regex).Alternate(rgx::Regex<Alphabet>("b"));
+  std::stringstream ss;
+  ss << regex << ' ' << copy << ' ' << copy.Reverse();
+  ASSERT_EQ(ss.str(),
+            "(ab+b)*a? (ab+b)*a?((ab+b)*a?)+b (a?(ba+b)*)a?(ba+b)*+b");
+}
+
+TEST(REGEX_TEST, STRUCTURAL_EQUALITY) {
+  using Alphabet = rgx::SimpleAlphabet<2>;
+  using Regex = rgx::Regex<Alphabet>;
+
+  Regex lhs("(ab+b)*a?");
+  Regex rhs = Regex("(ab+b)*").Concat(Regex("a?"));
+  ASSERT_EQ(lhs, rhs);
+  ASSERT_EQ(lhs.Hash(), rhs.Hash());
+  ASSERT_NE(lhs, Regex("(ab+b)*a*"));
+  ASSERT_NE(lhs, Regex("(b+ab)*a?"));
+
+  Regex twice = lhs;
+  twice.Reverse().Reverse();
+  ASSERT_EQ(twice, lhs);
+  ASSERT_NE(twice.GetImpl(), lhs.GetImpl());
+
+  std::unordered_set<Regex> set = {lhs, rhs, Regex("a"), Regex("(a)")};
+  ASSERT_EQ(set.size(), 2);
+
+  Regex pair("(ab)(ab)");
+  const auto* impl = pair.GetImpl();
+  auto subs = impl->GetSubregex(impl->Root());
+  ASSERT_EQ(subs[0], subs[1]);
+  Regex single("ab");
+  ASSERT_TRUE(
+      impl->Equal(subs[0], *single.GetImpl(), single.GetImpl()->Root()));
+
+  // r(r)* doubles the expanded tree but adds a few nodes; equal regexes from
+  // different arenas compare without expanding them.
+  auto doubled = [](char chr) {
+    Regex regex = Regex::SingeLetter(chr);
+    for (size_t i = 0; i < 40; ++i) {
+      Regex star = regex;
+      regex.Concat(star.Kleene());
+    }
+    return regex;
+  };
+  ASSERT_EQ(doubled('a'), doubled('a'));
+  ASSERT_NE(doubled('a'), doubled('b'));
+}
+
+TEST(REGEX_TEST, PARSE_ERRORS) {
+  using Impl = rgx::RegexImpl<rgx::SimpleAlphabet<2>>;
+  for (std::string bad : {"", "()", "a)", "(a", "ab+", "+a", "a**", "a*?",
+                          "a$b", "(a+)b", "a+(b)+", "c"}) {
+    ASSERT_EQ(Impl::FromString(bad), nullptr) << bad;
+  }
+  for (std::string good : {"_", "(a)", "a*b?", "(a+b)*_", "((a))?", "a+_"}) {
+    std::unique_ptr<Impl> regex(Impl::FromString(good));
+    ASSERT_NE(regex, nullptr) << good;
+  }
+}
+
+TEST(REGEX_TEST, PARSE_DEEP) {
+  using Impl = rgx::RegexImpl<rgx::SimpleAlphabet<2>>;
+  const size_t depth = 200000;
+  std::string deep;
+  for (size_t i = 0; i < depth; ++i) {
+    deep += "a(";
+  }
+  deep += "b";
+  deep += std::string(depth, ')');
+
+  std::unique_ptr<Impl> regex(Impl::FromString(deep));
+  ASSERT_NE(regex, nullptr);
+  ASSERT_EQ(regex->Size(), depth + 2);
+  ASSERT_EQ(regex->GetKind(), Impl::RK_Concatenate);
+  ASSERT_EQ(Impl::FromString(deep + ")"), nullptr);
+
+  // The innermost `(b)` needs no brackets.
+  std::stringstream ss;
+  ss << *regex;
+  ASSERT_EQ(ss.str(), deep.substr(0, 2 * depth - 1) + "b" +
+                          std::string(depth - 1, ')'));
+}
+
+TEST(REGEX_TEST, POLISH_NOTATION) {
+  using Regex = rgx::Regex<rgx::SimpleAlphabet<3>>;
+  std::stringstream ss;
+  ss << Regex::FromReversePolishNotation("ab+*c$") << ' '
+     << Regex::FromPolishNotation("$*+abc") << ' '
+     << Regex::FromReversePolishNotation("ab$c$ab+$") << ' '
+     << Regex::FromReversePolishNotation("a_$_b$$");
+  ASSERT_EQ(ss.str(), "(a+b)*c (a+b)*c abc(a+b) ab");
+  ASSERT_EQ(Regex::FromReversePolishNotation("ab+*c$"),
+            Regex::FromPolishNotation("$*+abc"));
+
+  for (std::string bad : {"", "a$", "*", "ab", "ab+c", "a?", "(a)", "ab+)"}) {
+    ASSERT_EQ(Regex::FromReversePolishNotation(bad).GetImpl(), nullptr) << bad;
+    ASSERT_FALSE(Regex::ParseReversePolishNotation(bad).has_value()) << bad;
+  }
+  for (std::string bad : {"", "$a", "*", "ab", "+abc", "?a", "+a(b)"}) {
+    ASSERT_EQ(Regex::FromPolishNotation(bad).GetImpl(), nullptr) << bad;
+    ASSERT_FALSE(Regex::ParsePolishNotation(bad).has_value()) << bad;
+  }
+  ASSERT_EQ(Regex::ParsePolishNotation("$*+abc"),
+            Regex::FromPolishNotation("$*+abc"));
+}
+
+TEST(REGEX_TEST, POLISH_NOTATION_LONG) {
+  using Impl = rgx::RegexImpl<rgx::SimpleAlphabet<2>>;
+  const size_t length = 200000;
+  std::string rpn = "a";
+  std::string pn;
+  for (size_t i = 0; i < length; ++i) {
+    rpn += "b$";
+    pn += '+';
+  }
+  pn += std::string(length + 1, 'a');
+
+  std::unique_ptr<Impl> concat(Impl::FromReversePolishNotation(rpn));
+  ASSERT_NE(concat, nullptr);
+  ASSERT_EQ(concat->GetKind(), Impl::RK_Concatenate);
+  ASSERT_EQ(concat->GetSubregex(concat->Root()).size(), length + 1);
+
+  std::unique_ptr<Impl> alternate(Impl::FromPolishNotation(pn));
+  ASSERT_NE(alternate, nullptr);
+  ASSERT_EQ(alternate->GetKind(), Impl::RK_Alternate);
+  ASSERT_EQ(alternate->Size(), 2);
+}
+
+TEST(REGEX_TEST, CONCAT_CHAIN) {
+  using Alphabet = rgx::SimpleAlphabet<2>;
+  using Regex = rgx::Regex<Alphabet>;
+  const size_t length = 200000;
+  Regex chain("a");
+  for (size_t i = 1; i < length; ++i) {
+    chain.Concat(Regex::SingeLetter(i % 2 ? 'b' : 'a'));
+  }
+  const auto* impl = chain.GetImpl();
+  ASSERT_EQ(impl->Size(), 3);  // Two letters and one list.
+  ASSERT_EQ(impl->GetSubregex(impl->Root()).size(), length);
+
+  // Every edit leaves the root interned; extending it again reuses its room.
+  chain.Concat(Regex("a")).Alternate(Regex("b")).Alternate(Regex("a"));
+  impl = chain.GetImpl();
+  ASSERT_EQ(impl->Size(), 4);
+  ASSERT_EQ(impl->GetKind(), rgx::RegexImpl<Alphabet>::RK_Alternate);
+  ASSERT_EQ(impl->GetSubregex(impl->Root()).size(), 3);
+
+  std::stringstream ss;
+  ss << Regex("a").Alternate(Regex("b")).Concat(Regex("a")).Concat(Regex("b"));
+  ASSERT_EQ(ss.str(), "(a+b)ab");
+}
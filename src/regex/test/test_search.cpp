@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../search.hpp"
+#include "../tranforms.hpp"
+#include "alphabet.hpp"
+
+using namespace rgx;
+
+namespace {
+
+// Leftmost-longest matches found with an anchored match at every offset.
+template <typename Alphabet>
+std::vector<SearchMatch> NaiveFindAll(const Regex<Alphabet>& regex,
+                                      const std::string& text) {
+  auto nfa = GlushkovNFAFromRegex(regex).Freeze();
+  std::vector<SearchMatch> matches;
+  for (size_t begin = 0; begin <= text.size();) {
+    size_t length = nfa.MaxMatch(std::string_view(text).substr(begin));
+    if (length == NFSA<Alphabet>::kNoMatch) {
+      ++begin;
+      continue;
+    }
+    matches.push_back({begin, begin + length});
+    begin += length > 0 ? length : 1;
+  }
+  return matches;
+}
+
+}  // namespace
+
+TEST(TEST_SEARCH, TEST_SAME_AS_NAIVE) {
+  using Alphabet = SimpleAlphabet<3>;
+  std::mt19937 rng(3);
+  for (std::string rgx : {"ab", "a(b+c)*a", "b*", "(ab+ba)*(_+c)", "ca?b?c",
+                          "(a+b)*c(a+b)", "abc+bc", "_", "a+a*b",
+                          "(a+b)*b+c"}) {
+    Regex<Alphabet> regex(rgx);
+    Searcher<Alphabet> searcher(regex);
+    for (size_t length : {0, 1, 5, 40, 300}) {
+      for (size_t round = 0; round < 20; ++round) {
+        std::string text(length, 'a');
+        for (char& chr : text) {
+          // Mostly letters, sometimes a character outside the alphabet.
+          chr = "abcabcabcz"[rng() % 10];
+        }
+        auto expected = NaiveFindAll(regex, text);
+        ASSERT_EQ(searcher.FindAll(text), expected) << rgx << ' ' << text;
+        ASSERT_EQ(searcher.Count(text), expected.size()) << rgx << ' ' << text;
+        auto first = searcher.FindFirst(text);
+        ASSERT_EQ(first.has_value(), !expected.empty()) << rgx << ' ' << text;
+        if (first) {
+          ASSERT_EQ(*first, expected[0]) << rgx << ' ' << text;
+        }
+      }
+    }
+  }
+}
+
+TEST(TEST_SEARCH, TEST_LEFTMOST_LONGEST) {
+  using Alphabet = SimpleAlphabet<4>;
+  // "bc" ends first, but "abcd" starts further left.
+  Searcher<Alphabet> searcher(Regex<Alphabet>("abcd+bc"));
+  ASSERT_EQ(searcher.FindFirst("abcd"), (SearchMatch{0, 4}));
+  ASSERT_EQ(searcher.FindFirst("abcc"), (SearchMatch{1, 3}));
+  ASSERT_EQ(searcher.FindFirst("dddd"), std::nullopt);
+  ASSERT_EQ(searcher.Count("abcdabcbc"), 3);
+}
+
+TEST(TEST_SEARCH, TEST_LONG_TEXT) {
+  Searcher<CharAlphabet> searcher(Regex<CharAlphabet>("err(or)?"));
+  std::string line = "level=info msg=\"retrying after error\" code=err\n";
+  std::string text;
+  while (text.size() < 1000000) {
+    text += line;
+  }
+  size_t lines = text.size() / line.size();
+  auto matches = searcher.FindAll(text);
+  ASSERT_EQ(matches.size(), 2 * lines);
+  ASSERT_EQ(matches[0].end - matches[0].begin, 5);
+  ASSERT_EQ(matches[1].end - matches[1].begin, 3);
+  ASSERT_EQ(text.substr(matches[0].begin, 5), "error");
+}
+
+TEST(TEST_SEARCH, TEST_LINEAR) {
+  using Alphabet = SimpleAlphabet<2>;
+  // A match starts at every offset, and each anchored run could read to the
+  // end while `a*b` is still possible.
+  Searcher<Alphabet> searcher(Regex<Alphabet>("a+a*b"));
+  const size_t length = 1000000;
+  std::string text(length, 'a');
+  ASSERT_EQ(searcher.Count(text), length);
+  ASSERT_EQ(searcher.FindFirst(text), (SearchMatch{0, 1}));
+  text.back() = 'b';
+  auto matches = searcher.FindAll(text);
+  ASSERT_EQ(matches.size(), 1);
+  ASSERT_EQ(matches[0], (SearchMatch{0, length}));
+}
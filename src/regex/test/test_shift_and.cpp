@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+
+#include "../shift_and.hpp"
+#include "../tranforms.hpp"
+#include "alphabet.hpp"
+
+using namespace rgx;
+using Alphabet = SimpleAlphabet<2>;
+
+namespace {
+
+std::vector<std::string> AllWords(size_t max_len) {
+  std::vector<std::string> words = {""};
+  for (size_t i = 0; i < words.size(); ++i) {
+    if (words[i].size() < max_len) {
+      for (char chr : {'a', 'b', 'c'}) {
+        words.push_back(words[i] + chr);
+      }
+    }
+  }
+  return words;
+}
+
+}  // namespace
+
+TEST(TEST_SHIFT_AND, TEST_SAME_AS_NFSA) {
+  for (std::string rgx : {"(ab+ba)*(_+a+ba)", "a*b?a", "(a+b)*b(a+b)(a+b)",
+                          "_", "((a*)?b)*"}) {
+    auto nfa = NFAFromRegex(Regex<Alphabet>(rgx))
+                   .RemoveEpsilonTransitions()
+                   .Freeze();
+    auto bits = ShiftAndNFSA<Alphabet>::FromNFA(nfa);
+    ASSERT_TRUE(bits.has_value());
+    for (const std::string& word : AllWords(6)) {
+      ASSERT_EQ(bits->MaxMatch(word), nfa.MaxMatch(word)) << rgx << ' ' << word;
+    }
+  }
+}
+
+TEST(TEST_SHIFT_AND, TEST_TOO_BIG) {
+  std::string rgx;
+  for (size_t i = 0; i < 40; ++i) {
+    rgx += "(a+b)";
+  }
+  auto nfa =
+      NFAFromRegex(Regex<Alphabet>(rgx)).RemoveEpsilonTransitions().Freeze();
+  ASSERT_FALSE(ShiftAndNFSA<Alphabet>::FromNFA(nfa).has_value());
+
+  auto wide = ShiftAndNFSA<Alphabet, 2>::FromNFA(nfa);
+  ASSERT_TRUE(wide.has_value());
+  ASSERT_EQ(wide->MaxMatch(std::string(50, 'a')), 40);
+  ASSERT_EQ(wide->MaxMatch(std::string(39, 'b')), NFSA<Alphabet>::kNoMatch);
+}
+
+TEST(TEST_SHIFT_AND, TEST_EPSILON) {
+  auto nfa = NFAFromRegex(Regex<Alphabet>("a*")).Freeze();
+  ASSERT_FALSE(ShiftAndNFSA<Alphabet>::FromNFA(nfa).has_value());
+}
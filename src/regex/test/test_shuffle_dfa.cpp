@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include "../shuffle_dfa.hpp"
+#include "../tranforms.hpp"
+#include "alphabet.hpp"
+
+using namespace rgx;
+
+TEST(TEST_SHUFFLE_DFA, TEST_SAME_AS_FROZEN) {
+  using Alphabet = SimpleAlphabet<3>;
+  uint64_t seed = 3;
+  auto random_word = [&seed](size_t length, std::string_view letters) {
+    std::string word;
+    for (size_t i = 0; i < length; ++i) {
+      seed = seed * 6364136223846793005ul + 1442695040888963407ul;
+      word += letters[(seed >> 33) % letters.size()];
+    }
+    return word;
+  };
+
+  for (std::string rgx : {"(ab+ba)*(_+a+ba)", "(a+b)*a(a+b)(a+b)", "(a+b+c)*",
+                          "((a+b)(a+b)(a+b))*c?", "_"}) {
+    auto fdfa = MDFAFromRegex(Regex<Alphabet>(rgx));
+    FrozenFDFA<Alphabet> frozen(fdfa);
+    auto shuffle = ShuffleDFA<Alphabet>::FromFDFA(fdfa);
+    ASSERT_TRUE(shuffle.has_value()) << rgx;
+    ASSERT_EQ(shuffle->Size(), frozen.Size());
+
+    for (size_t length : {0, 1, 5, 255, 256, 257, 1000, 4099}) {
+      for (std::string_view letters : {"ab", "abc", "abcd"}) {
+        std::string word = random_word(length, letters);
+        ASSERT_EQ(shuffle->FullMatch(word), frozen.FullMatch(word))
+            << rgx << ' ' << word;
+        ASSERT_EQ(shuffle->MaxMatch(word), frozen.MaxMatch(word))
+            << rgx << ' ' << word;
+      }
+    }
+  }
+}
+
+TEST(TEST_SHUFFLE_DFA, TEST_TOO_BIG) {
+  using Alphabet = SimpleAlphabet<2>;
+  std::string rgx = "(a+b)*a";
+  for (size_t i = 0; i < 4; ++i) {
+    rgx += "(a+b)";
+  }
+  FrozenFDFA<Alphabet> dfa(MDFAFromRegex(Regex<Alphabet>(rgx)));
+  ASSERT_GT(dfa.Size(), ShuffleDFA<Alphabet>::kMaxStates);
+  ASSERT_FALSE(ShuffleDFA<Alphabet>::FromFrozen(dfa).has_value());
+
+  std::string word(1000, 'a');
+  auto small = ShuffleDFA<Alphabet>::FromFDFA(
+      MDFAFromRegex(Regex<Alphabet>("(a+b)*a(a+b)")));
+  ASSERT_TRUE(small.has_value());
+  ASSERT_TRUE(small->FullMatch(word));
+  word[500] = 'c';
+  ASSERT_FALSE(small->FullMatch(word));
+  ASSERT_EQ(small->MaxMatch(word), 500);
+}
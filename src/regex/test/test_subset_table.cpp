@@ -0,0 +1,37 @@
+#include <gtest/gtest.h>
+
+#include "../subset_table.hpp"
+
+using namespace rgx;
+
+TEST(TEST_SUBSET_TABLE, TEST_INTERN) {
+  SubsetTable<size_t> table;
+  std::vector<size_t> empty = {};
+  std::vector<size_t> set1 = {1, 2, 3};
+  std::vector<size_t> set2 = {1, 2};
+
+  ASSERT_EQ(table.Intern(set1), std::make_pair(0ul, true));
+  ASSERT_EQ(table.Intern(empty), std::make_pair(1ul, true));
+  ASSERT_EQ(table.Intern(set2), std::make_pair(2ul, true));
+  ASSERT_EQ(table.Intern(set1), std::make_pair(0ul, false));
+  ASSERT_EQ(table.Intern(empty), std::make_pair(1ul, false));
+  ASSERT_EQ(table.Size(), 3);
+  ASSERT_TRUE(std::ranges::equal(table[2], set2));
+  ASSERT_TRUE(table[1].empty());
+
+  table.Clear();
+  ASSERT_EQ(table.Size(), 0);
+  ASSERT_EQ(table.Intern(set2), std::make_pair(0ul, true));
+}
+
+TEST(TEST_SUBSET_TABLE, TEST_GROW) {
+  SubsetTable<uint32_t> table;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    std::vector<uint32_t> set = {i, i + 1, 2 * i + 5};
+    ASSERT_EQ(table.Intern(set), std::make_pair(size_t{i}, true));
+  }
+  for (uint32_t i = 0; i < 1000; ++i) {
+    std::vector<uint32_t> set = {i, i + 1, 2 * i + 5};
+    ASSERT_EQ(table.Intern(set), std::make_pair(size_t{i}, false));
+  }
+}
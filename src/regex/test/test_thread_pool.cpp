@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../thread_pool.hpp"
+
+using namespace rgx;
+
+TEST(TEST_THREAD_POOL, TEST_EVERY_TASK_ONCE) {
+  for (size_t threads : {1, 2, 4}) {
+    ThreadPool pool(threads);
+    ASSERT_EQ(pool.Size(), threads);
+    for (size_t n : {0, 1, 3, 100, 1000}) {
+      std::vector<std::atomic<int>> runs(n);
+      pool.ParallelFor(n, [&](size_t task) {
+        // Uneven tasks, so that threads run out early and steal.
+        if (task % 7 == 0) {
+          std::this_thread::yield();
+        }
+        runs[task].fetch_add(1);
+      });
+      for (size_t task = 0; task < n; ++task) {
+        ASSERT_EQ(runs[task].load(), 1) << threads << ' ' << n << ' ' << task;
+      }
+    }
+  }
+}
+
+TEST(TEST_THREAD_POOL, TEST_CONCURRENT_LOOPS) {
+  ThreadPool pool(3);
+  std::atomic<size_t> sum = 0;
+  std::vector<std::thread> callers;
+  for (size_t caller = 0; caller < 4; ++caller) {
+    callers.emplace_back([&] {
+      for (size_t loop = 0; loop < 20; ++loop) {
+        pool.ParallelFor(50, [&](size_t task) { sum.fetch_add(task); });
+      }
+    });
+  }
+  for (auto& caller : callers) {
+    caller.join();
+  }
+  ASSERT_EQ(sum.load(), 4 * 20 * (49 * 50 / 2));
+}
@@ -41,3 +41,230 @@ TEST(TRANSFORM_TEST, RECREATION2) {
 TEST(TRANSFORM_TEST, MAXMATCH) {
   ASSERT_EQ(rgx::MaxRegexMatch<rgx::CanonicalAlphabet<3>>("ab+*c.", "ababaccaba"), 6);
 }
+
+TEST(TRANSFORM_TEST, GLUSHKOV) {
+  using Alphabet = rgx::SimpleAlphabet<2>;
+  for (std::string s : {"(ab+ba)*(_+a+ba)", "((a*)*b?)*a", "_", "(a+_)(b+_)"}) {
+    auto regex = rgx::Regex<Alphabet>(s);
+    auto glushkov = rgx::GlushkovNFAFromRegex(regex);
+    ASSERT_FALSE(glushkov.IsAnyEpsilon());
+    ASSERT_EQ(glushkov.Size(),
+              std::count_if(s.begin(), s.end(),
+                            [](char chr) { return chr == 'a' || chr == 'b'; }) +
+                  1);
+
+    auto thompson = rgx::NFAFromRegex(regex).RemoveEpsilonTransitions();
+    auto expected = rgx::Minimize(rgx::FDFAFromNFA(thompson));
+    auto actual = rgx::Minimize(rgx::FDFAFromNFA(glushkov));
+    ASSERT_EQ(actual.Size(), expected.Size());
+    for (std::string word : {"", "a", "b", "ab", "ba", "aab", "abba", "bab"}) {
+      ASSERT_EQ(glushkov.MaxMatch(word), thompson.MaxMatch(word));
+    }
+  }
+}
+
+namespace {
+
+template <typename Alphabet, typename Node>
+bool Accepts(const rgx::FDFA<Alphabet, Node>& dfa, std::string_view word) {
+  Node state = dfa.Start();
+  for (char chr : word) {
+    state = dfa.Transitions(state)[Alphabet::Ord(chr)];
+    if (state == rgx::FDFA<Alphabet, Node>::kErrorState) {
+      return false;
+    }
+  }
+  return dfa.IsFinite(state);
+}
+
+}  // namespace
+
+TEST(TRANSFORM_TEST, HOPCROFT) {
+  using Alphabet = rgx::SimpleAlphabet<2>;
+  for (std::string s : {"(ab+ba)*(_+a+ba)", "(a+b)*a(a+b)(a+b)(a+b)", "a*",
+                        "(aa+b)*(bb+a)?", "_"}) {
+    auto dfa = rgx::FDFAFromNFA(rgx::GlushkovNFAFromRegex(
+        rgx::Regex<Alphabet>(s)));
+    auto naive = rgx::Minimize(dfa, rgx::MinimizeAlgorithm::Naive);
+    auto hopcroft = rgx::Minimize(dfa);
+    ASSERT_EQ(hopcroft.Size(), naive.Size()) << s;
+    for (std::string word : {"", "a", "b", "ab", "ba", "aab", "abba", "babab",
+                             "bbbb", "aaaab"}) {
+      ASSERT_EQ(Accepts(hopcroft, word), Accepts(dfa, word)) << s << word;
+    }
+  }
+
+  std::string s = "(a+b)*a";
+  for (size_t i = 0; i < 8; ++i) {
+    s += "(a+b)";
+  }
+  auto dfa = rgx::MDFAFromRegex(rgx::Regex<Alphabet>(s));
+  ASSERT_EQ(dfa.Size(), 512);
+}
+
+TEST(TRANSFORM_TEST, HOPCROFT_PARTIAL) {
+  using Alphabet = rgx::SimpleAlphabet<2>;
+  rgx::FDFA<Alphabet> dfa;
+  dfa.CreateNode();
+  dfa.CreateNode();
+  dfa.SetTransition(0, 1, 1);
+  dfa.SetTransition(1, 1, 2);
+  dfa.SetTransition(2, 1, 1);
+  dfa.MakeFinite(1);
+
+  auto min = rgx::Minimize(dfa);
+  ASSERT_EQ(min.Size(), 2);
+  ASSERT_EQ(min.Transitions(min.Start())[2],
+            (rgx::FDFA<Alphabet>::kErrorState));
+  ASSERT_TRUE(Accepts(min, "aaa"));
+  ASSERT_FALSE(Accepts(min, "aa"));
+  ASSERT_FALSE(Accepts(min, "ab"));
+}
+
+TEST(TRANSFORM_TEST, NARROW_NODES) {
+  using Alphabet = rgx::SimpleAlphabet<2>;
+  std::string s1 = "(ab+ba)*(_+a+ba)";
+  auto regex = rgx::Regex<Alphabet>(s1);
+
+  auto nfa = rgx::NFAFromRegex<Alphabet, uint16_t>(regex);
+  nfa.RemoveEpsilonTransitions();
+  auto dfa = rgx::FDFAFromNFA<uint16_t>(nfa);
+  static_assert(std::is_same_v<decltype(dfa), rgx::FDFA<Alphabet, uint16_t>>);
+  dfa.Inverse();
+  dfa = rgx::Minimize(dfa);
+  ASSERT_EQ((rgx::FDFA<Alphabet, uint16_t>::kErrorState), 0xffff);
+
+  auto wide_nfa = rgx::NFAFromRegex(regex);
+  auto wide = rgx::FDFAFromNFA(wide_nfa.RemoveEpsilonTransitions());
+  wide.Inverse();
+  wide = rgx::Minimize(wide);
+  std::stringstream narrow_dump;
+  std::stringstream wide_dump;
+  dfa.TextDump(narrow_dump);
+  wide.TextDump(wide_dump);
+  ASSERT_EQ(narrow_dump.str(), wide_dump.str());
+
+  // uint8_t ids must print as numbers, not characters.
+  auto byte_nfa = rgx::NFAFromRegex<Alphabet, uint8_t>(regex);
+  byte_nfa.RemoveEpsilonTransitions();
+  std::stringstream byte_nfa_dump;
+  std::stringstream wide_nfa_dump;
+  byte_nfa.TextDump(byte_nfa_dump);
+  wide_nfa.TextDump(wide_nfa_dump);
+  ASSERT_EQ(byte_nfa_dump.str(), wide_nfa_dump.str());
+
+  auto byte_dfa = rgx::FDFAFromNFA<uint8_t>(byte_nfa);
+  byte_dfa.Inverse();
+  byte_dfa = rgx::Minimize(byte_dfa);
+  std::stringstream byte_dump;
+  byte_dfa.TextDump(byte_dump);
+  ASSERT_EQ(byte_dump.str(), wide_dump.str());
+
+  std::stringstream ss;
+  ss << rgx::RegexFromFDFA(dfa);
+  ASSERT_EQ(ss.str(), "(ba+ab)*((aa+bb)(a+b)*+b)");
+
+  auto glushkov = rgx::Minimize(
+      rgx::FDFAFromNFA(rgx::GlushkovNFAFromRegex<Alphabet, uint32_t>(regex)));
+  for (std::string word : {"", "a", "ab", "abba", "abbab", "bb"}) {
+    ASSERT_EQ(Accepts(glushkov, word), !Accepts(dfa, word)) << word;
+  }
+}
+
+TEST(TRANSFORM_TEST, NARROW_NFA_WIDE_DFA) {
+  using Alphabet = rgx::SimpleAlphabet<2>;
+  // Ninth letter from the end is `a`: 20 NFA states, 513 DFA states.
+  std::string rgx = "(a+b)*a";
+  for (size_t i = 0; i < 8; ++i) {
+    rgx += "(a+b)";
+  }
+  auto regex = rgx::Regex<Alphabet>(rgx);
+  auto nfa = rgx::GlushkovNFAFromRegex<Alphabet, uint8_t>(regex);
+  ASSERT_EQ(nfa.Size(), 20);
+
+  auto dfa = rgx::FDFAFromNFA(nfa);
+  ASSERT_EQ(dfa.Size(), 513);
+  ASSERT_EQ(rgx::Minimize(dfa).Size(), 512);
+  ASSERT_THROW(rgx::FDFAFromNFA<uint8_t>(nfa), std::length_error);
+
+  auto narrow = rgx::MDFAFromRegex<Alphabet, uint16_t>(regex);
+  ASSERT_EQ(narrow.Size(), 512);
+  ASSERT_TRUE(Accepts(narrow, "abbbbbbbb"));
+  ASSERT_FALSE(Accepts(narrow, "abbbbbbbbb"));
+  ASSERT_THROW((rgx::MDFAFromRegex<Alphabet, uint8_t>(regex)),
+               std::length_error);
+}
+
+TEST(TRANSFORM_TEST, NARROW_FULL_WIDTH) {
+  using Alphabet = rgx::SimpleAlphabet<1>;
+  // A chain of 255 states, the most uint8_t allows, with the last edge
+  // missing: the sink Hopcroft adds is state 255 == kErrorState.
+  rgx::FDFA<Alphabet, uint8_t> dfa;
+  while (dfa.Size() < rgx::FDFA<Alphabet, uint8_t>::kErrorState) {
+    uint8_t last = dfa.Size() - 1;
+    dfa.SetTransition(last, 1, dfa.CreateNode());
+  }
+  dfa.MakeFinite(dfa.Size() - 1);
+
+  auto min = rgx::Minimize(dfa);
+  ASSERT_EQ(min.Size(), 255);
+  ASSERT_TRUE(Accepts(min, std::string(254, 'a')));
+  ASSERT_FALSE(Accepts(min, std::string(253, 'a')));
+  ASSERT_FALSE(Accepts(min, std::string(255, 'a')));
+}
+
+TEST(TRANSFORM_TEST, NARROW_NFA_OVERFLOW) {
+  using Alphabet = rgx::SimpleAlphabet<2>;
+  // 254 letters fill the uint8_t ids of a Glushkov NFA, one more overflows.
+  auto fits = rgx::Regex<Alphabet>(std::string(254, 'a'));
+  ASSERT_EQ((rgx::GlushkovNFAFromRegex<Alphabet, uint8_t>(fits).Size()), 255);
+  auto regex = rgx::Regex<Alphabet>(std::string(301, 'a'));
+  ASSERT_THROW((rgx::GlushkovNFAFromRegex<Alphabet, uint8_t>(regex)),
+               std::length_error);
+  ASSERT_THROW((rgx::NFAFromRegex<Alphabet, uint8_t>(regex)),
+               std::length_error);
+
+  rgx::NFSA<Alphabet, uint8_t> nfa;
+  while (nfa.Size() < rgx::NFSA<Alphabet, uint8_t>::kErrorState) {
+    nfa.CreateNode();
+  }
+  ASSERT_THROW(nfa.CreateNode(), std::length_error);
+}
+
+TEST(TRANSFORM_TEST, EMPTY_LANGUAGE) {
+  using Alphabet = rgx::SimpleAlphabet<2>;
+  rgx::FDFA<Alphabet> dfa;
+  dfa.SetTransition(dfa.Start(), 1, dfa.CreateNode());
+  ASSERT_EQ(rgx::RegexFromFDFA(dfa).GetImpl(), nullptr);
+}
+
+TEST(TRANSFORM_TEST, THOMPSON_LONG) {
+  using Alphabet = rgx::SimpleAlphabet<2>;
+  const size_t length = 100000;
+  std::string word;
+  for (size_t i = 0; i < length; ++i) {
+    word += i % 3 ? 'a' : 'b';
+  }
+
+  auto nfa = rgx::NFAFromRegex(rgx::Regex<Alphabet>(word + "(a+b)*"));
+  ASSERT_EQ(nfa.Size(), 2 * length + 8);
+  nfa.RemoveEpsilonTransitions();
+  ASSERT_EQ(nfa.MaxMatch(word + "ab"), length + 2);
+  ASSERT_EQ(nfa.MaxMatch(word.substr(1)), rgx::NFSA<Alphabet>::kNoMatch);
+}
+
+TEST(TRANSFORM_TEST, GLUSHKOV_DEEP) {
+  using Alphabet = rgx::SimpleAlphabet<2>;
+  const size_t depth = 200000;
+  std::string deep;
+  for (size_t i = 0; i < depth; ++i) {
+    deep += "a(";
+  }
+  deep += "b";
+  deep += std::string(depth, ')');
+
+  auto nfa = rgx::GlushkovNFAFromRegex(rgx::Regex<Alphabet>(deep));
+  ASSERT_EQ(nfa.Size(), depth + 2);
+  ASSERT_EQ(nfa.MaxMatch(std::string(depth, 'a') + "bb"), depth + 1);
+  ASSERT_EQ(nfa.MaxMatch(std::string(depth, 'a') + "a"), nfa.kNoMatch);
+}
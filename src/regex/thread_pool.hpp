@@ -0,0 +1,155 @@
+#ifndef REGEX_THREAD_POOL_HPP
+#define REGEX_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rgx {
+
+/*
+ * Fixed set of threads running fork-join loops.
+ *
+ * ParallelFor(n, fn) deals [0, n) out in equal ranges to the workers and the
+ * calling thread. Each one takes indices from the front of its own range and,
+ * once that is empty, steals the back half of someone else's, so uneven
+ * tasks still keep every thread busy. Loops from different threads run one
+ * after another.
+ */
+class ThreadPool {
+  struct Range {
+    std::mutex mutex;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  std::vector<Range> ranges_;  // The caller's is ranges_[0].
+  std::vector<std::thread> workers_;
+
+  std::mutex run_mutex_;  // Held for a whole ParallelFor.
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  const std::function<void(size_t)>* job_ = nullptr;
+  uint64_t generation_ = 0;
+  size_t busy_ = 0;  // Workers still in the current loop.
+  bool stop_ = false;
+
+  bool TakeOwn(size_t self, size_t& task) {
+    std::lock_guard lock(ranges_[self].mutex);
+    if (ranges_[self].begin == ranges_[self].end) {
+      return false;
+    }
+    task = ranges_[self].begin++;
+    return true;
+  }
+
+  bool Steal(size_t self, size_t& task) {
+    for (size_t i = 1; i < ranges_.size(); ++i) {
+      Range& victim = ranges_[(self + i) % ranges_.size()];
+      size_t begin;
+      size_t end;
+      {
+        std::lock_guard lock(victim.mutex);
+        if (victim.begin == victim.end) {
+          continue;
+        }
+        begin = victim.begin + (victim.end - victim.begin) / 2;
+        end = victim.end;
+        victim.end = begin;
+      }
+      task = begin;
+      std::lock_guard lock(ranges_[self].mutex);
+      ranges_[self].begin = begin + 1;
+      ranges_[self].end = end;
+      return true;
+    }
+    return false;
+  }
+
+  // Runs tasks until no range has any left.
+  void Participate(size_t self, const std::function<void(size_t)>& job) {
+    size_t task;
+    while (TakeOwn(self, task) || Steal(self, task)) {
+      job(task);
+    }
+  }
+
+  void WorkerLoop(size_t self) {
+    uint64_t seen = 0;
+    std::unique_lock lock(mutex_);
+    while (true) {
+      wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+      const auto* job = job_;
+      lock.unlock();
+      Participate(self, *job);
+      lock.lock();
+      if (--busy_ == 0) {
+        done_.notify_one();
+      }
+    }
+  }
+
+ public:
+  // `threads` counts the thread calling ParallelFor, so 1 runs everything
+  // there.
+  explicit ThreadPool(
+      size_t threads = std::max(1u, std::thread::hardware_concurrency()))
+      : ranges_(std::max<size_t>(threads, 1)) {
+    for (size_t self = 1; self < ranges_.size(); ++self) {
+      workers_.emplace_back([this, self] { WorkerLoop(self); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  size_t Size() const { return ranges_.size(); }
+
+  // Calls fn(i) once for every i in [0, n) and returns when all calls have.
+  // `fn` must not throw.
+  template <typename Fn>
+  void ParallelFor(size_t n, Fn&& fn) {
+    std::function<void(size_t)> job = std::ref(fn);
+    std::lock_guard run(run_mutex_);
+    for (size_t i = 0; i < ranges_.size(); ++i) {
+      std::lock_guard lock(ranges_[i].mutex);
+      ranges_[i].begin = n * i / ranges_.size();
+      ranges_[i].end = n * (i + 1) / ranges_.size();
+    }
+    {
+      std::lock_guard lock(mutex_);
+      job_ = &job;
+      ++generation_;
+      busy_ = workers_.size();
+    }
+    wake_.notify_all();
+    Participate(0, job);
+    std::unique_lock lock(mutex_);
+    done_.wait(lock, [this] { return busy_ == 0; });
+  }
+};
+
+}  // namespace rgx
+
+#endif /* REGEX_THREAD_POOL_HPP */
@@ -1,116 +1,399 @@
 #ifndef REGEX_TRANFORMS_HPP
 #define REGEX_TRANFORMS_HPP
 
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+
 #include "alphabet.hpp"
 #include "fdfa.hpp"
 #include "nfa.hpp"
 #include "regex.hpp"
+#include "subset_table.hpp"
 
 namespace rgx {
 
 namespace details {
-template <typename Alphabet>
-NFSA<Alphabet> NFAFromRegex(const RegexImpl<Alphabet>* regex) {
-  if (!regex) {
-    return NFSA<Alphabet>{};
+/*
+ * Thompson construction straight into one automaton. Every subexpression
+ * becomes a fragment with one entry and one exit state; no edge enters the
+ * entry and none leaves the exit, so fragments are joined by epsilon edges
+ * without touching their insides. The number of states is counted from the
+ * arena first, so the automaton is allocated once.
+ */
+template <typename Alphabet, typename Node = std::size_t>
+class ThompsonBuilder {
+  using Impl = RegexImpl<Alphabet>;
+  using Id = typename Impl::Id;
+  static const constexpr uint64_t kEpsilon = NFSA<Alphabet, Node>::kEpsilon;
+
+  struct Fragment {
+    Node entry;
+    Node exit;
+  };
+
+  struct Frame {
+    Id id;
+    size_t next_sub;
+  };
+
+  NFSA<Alphabet, Node> nfsa_;
+  bool start_used_ = false;
+  std::vector<Fragment> fragments_;
+  std::vector<Frame> frames_;
+
+  Node NewState() {
+    if (!start_used_) {
+      start_used_ = true;
+      return nfsa_.Start();
+    }
+    return nfsa_.CreateNode();
   }
 
-  switch (regex->GetKind()) {
-    case RegexImpl<Alphabet>::RK_Empty: {
-      NFSA<Alphabet> nfsa{};
-      auto node = nfsa.CreateNode();
-      nfsa.AddTransition(nfsa.Start(), NFSA<Alphabet>::kEpsilon, node);
-      nfsa.MakeFinite(node);
-      return nfsa;
+  // States of every subexpression. Subexpressions precede their parents in
+  // the arena, so one forward pass is enough.
+  static size_t CountStates(const Impl& regex) {
+    std::vector<size_t> states(regex.Size());
+    for (Id id = 0; id < regex.Size(); ++id) {
+      size_t subs = 0;
+      for (Id sub : regex.GetSubregex(id)) {
+        subs += states[sub];
+      }
+      switch (regex.GetKind(id)) {
+        case Impl::RK_Empty:
+          states[id] = 1;
+          break;
+        case Impl::RK_Letter:
+        case Impl::RK_Kleene:
+        case Impl::RK_Optional:
+        case Impl::RK_Alternate:
+          states[id] = subs + 2;
+          break;
+        case Impl::RK_Concatenate:
+          states[id] = subs;
+          break;
+        default:
+          assert(0 && "Bad regex");
+          abort();
+      }
     }
+    return states[regex.Root()];
+  }
 
-    case RegexImpl<Alphabet>::RK_Letter: {
-      NFSA<Alphabet> nfsa{};
-      auto node = nfsa.CreateNode();
-      nfsa.AddTransition(
-          nfsa.Start(),
-          Alphabet::Ord(
-              mgk::Cast<RegexLetter<Alphabet>>(regex)->GetLetterChr()),
-          node);
-      nfsa.MakeFinite(node);
-      nfsa.Validate();
-      return nfsa;
+  // Replaces the fragments of the subexpressions of `id` on top of the stack
+  // by the fragment of `id`.
+  void Combine(const Impl& regex, Id id) {
+    size_t num_subs = regex.GetSubregex(id).size();
+    auto subs = std::span(fragments_).last(num_subs);
+    Fragment result;
+    switch (regex.GetKind(id)) {
+      case Impl::RK_Empty: {
+        Node state = NewState();
+        result = {state, state};
+        break;
+      }
+      case Impl::RK_Letter:
+        result = {NewState(), NewState()};
+        nfsa_.AddTransition(result.entry, regex.GetLetter(id), result.exit);
+        break;
+      case Impl::RK_Kleene:
+      case Impl::RK_Optional:
+        result = {NewState(), NewState()};
+        nfsa_.AddTransition(result.entry, kEpsilon, subs[0].entry);
+        nfsa_.AddTransition(result.entry, kEpsilon, result.exit);
+        nfsa_.AddTransition(subs[0].exit, kEpsilon, result.exit);
+        if (regex.GetKind(id) == Impl::RK_Kleene) {
+          nfsa_.AddTransition(subs[0].exit, kEpsilon, subs[0].entry);
+        }
+        break;
+      case Impl::RK_Alternate:
+        result = {NewState(), NewState()};
+        for (const Fragment& sub : subs) {
+          nfsa_.AddTransition(result.entry, kEpsilon, sub.entry);
+          nfsa_.AddTransition(sub.exit, kEpsilon, result.exit);
+        }
+        break;
+      case Impl::RK_Concatenate:
+        result = {subs.front().entry, subs.back().exit};
+        for (size_t i = 1; i < subs.size(); ++i) {
+          nfsa_.AddTransition(subs[i - 1].exit, kEpsilon, subs[i].entry);
+        }
+        break;
+      default:
+        assert(0 && "Bad regex");
+        abort();
     }
+    fragments_.resize(fragments_.size() - num_subs);
+    fragments_.push_back(result);
+  }
 
-    case RegexImpl<Alphabet>::RK_Kleene: {
-      auto* kleene_regex = mgk::Cast<RegexQuantified<Alphabet>>(regex);
-      NFSA<Alphabet> nfsa = NFAFromRegex(kleene_regex->GetSubregex());
-      nfsa.Validate();
-      nfsa.Kleene();
-      return nfsa;
+ public:
+  NFSA<Alphabet, Node> Build(const Impl* regex) {
+    if (!regex) {
+      return std::move(nfsa_);
     }
-    case RegexImpl<Alphabet>::RK_Optional: {
-      auto* opt_regex = mgk::Cast<RegexQuantified<Alphabet>>(regex);
-      NFSA<Alphabet> nfsa = NFAFromRegex(opt_regex->GetSubregex());
-      nfsa.Optional();
-      return nfsa;
+    size_t states = CountStates(*regex);
+    if (states > NFSA<Alphabet, Node>::kErrorState) {
+      throw std::length_error("NFA has too many states for its id type");
     }
-    case RegexImpl<Alphabet>::RK_Alternate: {
-      auto* alt_regex = mgk::Cast<RegexAlternate<Alphabet>>(regex);
-      NFSA<Alphabet> nfsa = NFAFromRegex(alt_regex->GetSubregex()[0]);
-      for (size_t i = 1; i < alt_regex->GetSubregex().size(); ++i) {
-        nfsa.Alternate(NFAFromRegex(alt_regex->GetSubregex()[i]));
+    nfsa_.Reserve(states);
+
+    // Post-order walk. Shared subexpressions are expanded at every use.
+    frames_.push_back({regex->Root(), 0});
+    while (!frames_.empty()) {
+      Frame& frame = frames_.back();
+      auto subs = regex->GetSubregex(frame.id);
+      if (frame.next_sub < subs.size()) {
+        frames_.push_back({subs[frame.next_sub++], 0});
+        continue;
+      }
+      Id id = frame.id;
+      frames_.pop_back();
+      Combine(*regex, id);
+    }
+
+    nfsa_.SetStart(fragments_.back().entry);
+    nfsa_.MakeFinite(fragments_.back().exit);
+    nfsa_.Validate();
+    return std::move(nfsa_);
+  }
+};
+
+/*
+ * Position automaton construction. Every letter of the regex is a position,
+ * state 0 is the start. For every subexpression we compute whether it
+ * accepts the empty word and which positions can be first and last in its
+ * words; concatenation and Kleene star then link last positions to first.
+ */
+template <typename Alphabet, typename Node = std::size_t>
+class GlushkovBuilder {
+  struct Sets {
+    bool nullable = false;
+    std::vector<Node> first;
+    std::vector<Node> last;
+  };
+
+  std::vector<uint64_t> letters_ = {NFSA<Alphabet>::kEpsilon};
+  std::vector<std::pair<Node, Node>> follow_;
+  const RegexImpl<Alphabet>* regex_ = nullptr;
+
+  void Link(const std::vector<Node>& from, const std::vector<Node>& to) {
+    for (Node last : from) {
+      for (Node first : to) {
+        follow_.emplace_back(last, first);
       }
-      nfsa.Validate();
-      return nfsa;
     }
-    case RegexImpl<Alphabet>::RK_Concatenate: {
-      auto* cat_regex = mgk::Cast<RegexConcatenate<Alphabet>>(regex);
-      NFSA<Alphabet> nfsa = NFAFromRegex(cat_regex->GetSubregex()[0]);
-      for (size_t i = 1; i < cat_regex->GetSubregex().size(); ++i) {
-        nfsa.Concat(NFAFromRegex(cat_regex->GetSubregex()[i]));
+  }
+
+  static void Append(std::vector<Node>& to, const std::vector<Node>& from) {
+    to.insert(to.end(), from.begin(), from.end());
+  }
+
+  // Sets of `id` from the sets of its subexpressions, which are taken.
+  Sets Combine(typename RegexImpl<Alphabet>::Id id, std::span<Sets> subs) {
+    switch (regex_->GetKind(id)) {
+      case RegexImpl<Alphabet>::RK_Empty:
+        return {true, {}, {}};
+
+      case RegexImpl<Alphabet>::RK_Letter: {
+        if (letters_.size() >= NFSA<Alphabet, Node>::kErrorState) {
+          throw std::length_error("NFA has too many states for its id type");
+        }
+        Node pos = letters_.size();
+        letters_.push_back(regex_->GetLetter(id));
+        return {false, {pos}, {pos}};
       }
-      nfsa.Validate();
+
+      case RegexImpl<Alphabet>::RK_Kleene:
+      case RegexImpl<Alphabet>::RK_Optional: {
+        Sets sets = std::move(subs[0]);
+        if (regex_->GetKind(id) == RegexImpl<Alphabet>::RK_Kleene) {
+          Link(sets.last, sets.first);
+        }
+        sets.nullable = true;
+        return sets;
+      }
+
+      case RegexImpl<Alphabet>::RK_Alternate: {
+        Sets sets;
+        for (Sets& sub_sets : subs) {
+          sets.nullable |= sub_sets.nullable;
+          Append(sets.first, sub_sets.first);
+          Append(sets.last, sub_sets.last);
+        }
+        return sets;
+      }
+
+      case RegexImpl<Alphabet>::RK_Concatenate: {
+        Sets sets = {true, {}, {}};
+        for (Sets& sub_sets : subs) {
+          Link(sets.last, sub_sets.first);
+          if (sets.nullable) {
+            Append(sets.first, sub_sets.first);
+          }
+          if (sub_sets.nullable) {
+            Append(sub_sets.last, sets.last);
+          }
+          sets.last.swap(sub_sets.last);
+          sets.nullable &= sub_sets.nullable;
+        }
+        return sets;
+      }
+
+      default:
+        assert(0 && "Bad regex");
+        abort();
+    }
+  }
+
+  // Post-order walk with an explicit stack, so nesting depth doesn't use
+  // native stack. Letters get positions from left to right.
+  Sets Visit(typename RegexImpl<Alphabet>::Id root) {
+    struct Frame {
+      typename RegexImpl<Alphabet>::Id id;
+      size_t next_sub;
+    };
+    std::vector<Frame> frames = {{root, 0}};
+    std::vector<Sets> done;  // Sets of finished subexpressions.
+    while (!frames.empty()) {
+      Frame& frame = frames.back();
+      auto subs = regex_->GetSubregex(frame.id);
+      if (frame.next_sub < subs.size()) {
+        frames.push_back({subs[frame.next_sub++], 0});
+        continue;
+      }
+      auto id = frame.id;
+      frames.pop_back();
+      Sets sets = Combine(id, std::span(done).last(subs.size()));
+      done.resize(done.size() - subs.size());
+      done.push_back(std::move(sets));
+    }
+    return std::move(done.back());
+  }
+
+ public:
+  NFSA<Alphabet, Node> Build(const RegexImpl<Alphabet>* regex) {
+    NFSA<Alphabet, Node> nfsa{};
+    if (!regex) {
       return nfsa;
     }
-    default:
-      assert(0 && "Bad regex");
-      abort();
+
+    regex_ = regex;
+    Sets sets = Visit(regex->Root());
+    for (Node first : sets.first) {
+      follow_.emplace_back(nfsa.Start(), first);
+    }
+    std::sort(follow_.begin(), follow_.end());
+    follow_.erase(std::unique(follow_.begin(), follow_.end()), follow_.end());
+
+    for (size_t i = 1; i < letters_.size(); ++i) {
+      nfsa.CreateNode();
+    }
+    for (auto [from, to] : follow_) {
+      nfsa.AddTransition(from, letters_[to], to);
+    }
+    for (Node last : sets.last) {
+      nfsa.MakeFinite(last);
+    }
+    if (sets.nullable) {
+      nfsa.MakeFinite(nfsa.Start());
+    }
+    nfsa.Validate();
+    return nfsa;
   }
-}
+};
 }  // namespace details
 
-template <typename Alphabet>
-NFSA<Alphabet> NFAFromRegex(const Regex<Alphabet>& regex) {
-  return details::NFAFromRegex(regex.GetImpl());
+// The transforms keep the state id type of their input. Builders from a regex
+// take it as an explicit argument, e.g. NFAFromRegex<Alphabet, uint32_t>, and
+// throw std::length_error if the automaton has more states than it can number.
+template <typename Alphabet, typename Node = std::size_t>
+NFSA<Alphabet, Node> NFAFromRegex(const Regex<Alphabet>& regex) {
+  return details::ThompsonBuilder<Alphabet, Node>().Build(regex.GetImpl());
 }
 
-template <typename Alphabet>
-FDFA<Alphabet> FDFAFromNFA(const NFSA<Alphabet>& nfa) {
-  FDFA<Alphabet> dfa;
-  using Vertex = std::vector<typename NFSA<Alphabet>::Node>;
-  std::vector<Vertex> vertices = {{nfa.Start()}};
-
-  for (size_t i = 0; i < vertices.size(); ++i) {
-    for (uint64_t chr = 1; chr < Alphabet::kSize; ++chr) {
-      const Vertex& from = vertices[i];
-      Vertex to;
-      for (auto node : from) {
-        if (nfa.Transitions(node).find(chr) == nfa.Transitions(node).end()) {
-          continue;
+// Epsilon-free NFSA with one state per letter of `regex` plus the start.
+template <typename Alphabet, typename Node = std::size_t>
+NFSA<Alphabet, Node> GlushkovNFAFromRegex(const Regex<Alphabet>& regex) {
+  return details::GlushkovBuilder<Alphabet, Node>().Build(regex.GetImpl());
+}
+
+/*
+ * Subset construction. The DFA may have exponentially more states than the
+ * NFA, so it gets its own id type `DNode` instead of reusing the NFA's.
+ * Throws std::length_error if the DFA needs more states than `DNode` can
+ * number.
+ */
+template <typename DNode = std::size_t, typename Alphabet, typename Node>
+FDFA<Alphabet, DNode> FDFAFromNFA(const FrozenNFSA<Alphabet, Node>& nfa) {
+  using Edge = typename FrozenNFSA<Alphabet, Node>::Edge;
+  const DNode kErrorState = FDFA<Alphabet, DNode>::kErrorState;
+  FDFA<Alphabet, DNode> dfa;
+  SubsetTable<Node> vertices;
+  vertices.Intern(std::vector<Node>{nfa.Start()});
+
+  std::vector<Edge> moves;
+  std::vector<Node> to;
+  for (size_t i = 0; i < vertices.Size(); ++i) {
+    moves.clear();
+    for (Node node : vertices[i]) {
+      for (const Edge& edge : nfa.Transitions(node)) {
+        if (edge.symbol != FrozenNFSA<Alphabet, Node>::kEpsilon) {
+          moves.push_back(edge);
         }
-        to.insert(to.end(), nfa.Transitions(node).at(chr).begin(),
-                  nfa.Transitions(node).at(chr).end());
+      }
+    }
+    std::sort(moves.begin(), moves.end());
+
+    // Symbols without moves lead to the empty set. It gets its id at the
+    // first such symbol, same as if every symbol were tried in order.
+    uint64_t first_missing = 1;
+    for (const Edge& edge : moves) {
+      if (edge.symbol > first_missing) break;
+      first_missing = edge.symbol + 1;
+    }
+    auto add_vertex = [&](const std::vector<Node>& vertex) {
+      auto [id, added] = vertices.Intern(vertex);
+      if (added) {
+        if (dfa.Size() >= kErrorState) {
+          throw std::length_error("DFA has too many states for its id type");
+        }
+        dfa.CreateNode();
+      }
+      return id;
+    };
+
+    DNode dead = kErrorState;
+    for (size_t first = 0; first < moves.size();) {
+      uint64_t chr = moves[first].symbol;
+      if (first_missing < chr && dead == kErrorState) {
+        dead = add_vertex({});
       }
 
-      std::sort(to.begin(), to.end());
-      to.resize(std::unique(to.begin(), to.end()) - to.begin());
+      to.clear();
+      for (; first < moves.size() && moves[first].symbol == chr; ++first) {
+        if (to.empty() || to.back() != moves[first].to) {
+          to.push_back(moves[first].to);
+        }
+      }
+      dfa.SetTransition(i, chr, add_vertex(to));
+    }
 
-      size_t pos =
-          std::find(vertices.begin(), vertices.end(), to) - vertices.begin();
-      if (pos == vertices.size()) {
-        vertices.push_back(to);
-        dfa.CreateNode();
+    if (first_missing < Alphabet::kSize) {
+      if (dead == kErrorState) {
+        dead = add_vertex({});
+      }
+      for (uint64_t chr = 1; chr < Alphabet::kSize; ++chr) {
+        if (dfa.Transitions(i)[chr] == kErrorState) {
+          dfa.SetTransition(i, chr, dead);
+        }
       }
-      dfa.SetTransition(i, chr, pos);
     }
 
-    for (auto node : vertices[i]) {
+    for (Node node : vertices[i]) {
       if (nfa.IsFinite(node)) {
         dfa.MakeFinite(i);
       }
@@ -119,9 +402,41 @@ FDFA<Alphabet> FDFAFromNFA(const NFSA<Alphabet>& nfa) {
   return dfa;
 }
 
-template <typename Alphabet>
-FDFA<Alphabet> Minimize(const FDFA<Alphabet> fdfa) {
-  FDFA<Alphabet> mindfa;
+template <typename DNode = std::size_t, typename Alphabet, typename Node>
+FDFA<Alphabet, DNode> FDFAFromNFA(const NFSA<Alphabet, Node>& nfa) {
+  return FDFAFromNFA<DNode>(nfa.Freeze());
+}
+
+// Copy of `fdfa` with `Node` ids. Throws std::length_error if it has more
+// states than `Node` can number.
+template <typename Node, typename Alphabet, typename OtherNode>
+FDFA<Alphabet, Node> ConvertNodes(const FDFA<Alphabet, OtherNode>& fdfa) {
+  if (fdfa.Size() > FDFA<Alphabet, Node>::kErrorState) {
+    throw std::length_error("DFA has too many states for its id type");
+  }
+  FDFA<Alphabet, Node> result;
+  for (size_t node = 1; node < fdfa.Size(); ++node) {
+    result.CreateNode();
+  }
+  for (size_t node = 0; node < fdfa.Size(); ++node) {
+    for (uint64_t via = 1; via < Alphabet::kSize; ++via) {
+      OtherNode to = fdfa.Transitions(node)[via];
+      if (to != FDFA<Alphabet, OtherNode>::kErrorState) {
+        result.SetTransition(node, via, to);
+      }
+    }
+    if (fdfa.IsFinite(node)) {
+      result.MakeFinite(node);
+    }
+  }
+  result.SetStart(fdfa.Start());
+  return result;
+}
+
+namespace details {
+template <typename Alphabet, typename Node>
+FDFA<Alphabet, Node> NaiveMinimize(const FDFA<Alphabet, Node>& fdfa) {
+  FDFA<Alphabet, Node> mindfa;
   mindfa.CreateNode();
   mindfa.MakeFinite(1);
   std::vector<uint64_t> classes(fdfa.Size());
@@ -144,8 +459,8 @@ FDFA<Alphabet> Minimize(const FDFA<Alphabet> fdfa) {
         }
         continue;
       }
-      std::array<uint64_t, Alphabet::kSize> trans;
-      trans[0] = -1ul;
+      std::array<Node, Alphabet::kSize> trans;
+      trans[0] = FDFA<Alphabet, Node>::kErrorState;
       for (size_t via = 1; via < fdfa.Transitions(i).size(); ++via) {
         trans[via] = classes[fdfa.Transitions(i)[via]];
       }
@@ -181,8 +496,215 @@ FDFA<Alphabet> Minimize(const FDFA<Alphabet> fdfa) {
   return mindfa;
 }
 
-template <typename Alphabet>
-Regex<Alphabet> RegexFromFDFA(const FDFA<Alphabet>& dfa) {
+/*
+ * Hopcroft's partition refinement. States of a block occupy a contiguous
+ * range of `elements`; when a block is split, the smaller part becomes a new
+ * block and is queued as a splitter. Missing transitions go to an extra sink
+ * state, which is dropped again if it stays alone in its block.
+ */
+template <typename Alphabet, typename Node>
+FDFA<Alphabet, Node> HopcroftMinimize(const FDFA<Alphabet, Node>& fdfa) {
+  const Node kErrorState = FDFA<Alphabet, Node>::kErrorState;
+  const size_t symbols = Alphabet::kSize - 1;
+
+  bool has_sink = false;
+  for (size_t from = 0; from < fdfa.Size(); ++from) {
+    for (uint64_t via = 1; via < Alphabet::kSize; ++via) {
+      has_sink |= fdfa.Transitions(from)[via] == kErrorState;
+    }
+  }
+  // States are indexed by size_t: with the sink, `size` may exceed Node.
+  const size_t sink = fdfa.Size();
+  const size_t size = fdfa.Size() + has_sink;
+  auto target = [&](size_t from, uint64_t via) -> size_t {
+    if (from == sink || fdfa.Transitions(from)[via] == kErrorState) {
+      return sink;
+    }
+    return fdfa.Transitions(from)[via];
+  };
+
+  // Predecessors of `to` via `chr` are
+  // in_edges[in_offsets[(chr - 1) * size + to], ... + 1].
+  std::vector<size_t> in_offsets(symbols * size + 1, 0);
+  std::vector<size_t> in_edges(symbols * size);
+  for (size_t from = 0; from < size; ++from) {
+    for (uint64_t via = 1; via < Alphabet::kSize; ++via) {
+      ++in_offsets[(via - 1) * size + target(from, via) + 1];
+    }
+  }
+  for (size_t i = 1; i < in_offsets.size(); ++i) {
+    in_offsets[i] += in_offsets[i - 1];
+  }
+  std::vector<size_t> fill(in_offsets.begin(), in_offsets.end() - 1);
+  for (size_t from = 0; from < size; ++from) {
+    for (uint64_t via = 1; via < Alphabet::kSize; ++via) {
+      in_edges[fill[(via - 1) * size + target(from, via)]++] = from;
+    }
+  }
+
+  std::vector<size_t> elements(size);
+  std::vector<size_t> position(size);
+  std::vector<size_t> block(size);
+  std::vector<size_t> begin;
+  std::vector<size_t> end;
+  std::vector<size_t> marked;
+
+  auto is_finite = [&](size_t node) {
+    return node != sink && fdfa.IsFinite(node);
+  };
+  for (bool finite : {false, true}) {
+    size_t first = begin.empty() ? 0 : end.back();
+    size_t last = first;
+    for (size_t node = 0; node < size; ++node) {
+      if (is_finite(node) == finite) {
+        elements[last] = node;
+        position[node] = last++;
+        block[node] = begin.size();
+      }
+    }
+    if (last != first) {
+      begin.push_back(first);
+      end.push_back(last);
+      marked.push_back(0);
+    }
+  }
+
+  std::vector<size_t> worklist;
+  std::vector<bool> in_worklist(begin.size(), false);
+  if (begin.size() == 2) {
+    worklist.push_back(end[0] - begin[0] <= end[1] - begin[1] ? 0 : 1);
+    in_worklist[worklist.back()] = true;
+  }
+
+  std::vector<size_t> splitter;
+  std::vector<size_t> touched;
+  while (!worklist.empty()) {
+    size_t splitter_block = worklist.back();
+    worklist.pop_back();
+    in_worklist[splitter_block] = false;
+    splitter.assign(elements.begin() + begin[splitter_block],
+                    elements.begin() + end[splitter_block]);
+
+    for (uint64_t via = 1; via < Alphabet::kSize; ++via) {
+      touched.clear();
+      for (size_t to : splitter) {
+        size_t idx = (via - 1) * size + to;
+        for (size_t i = in_offsets[idx]; i < in_offsets[idx + 1]; ++i) {
+          size_t from = in_edges[i];
+          size_t blk = block[from];
+          size_t front = begin[blk] + marked[blk];
+          if (position[from] < front) {
+            continue;
+          }
+          std::swap(elements[position[from]], elements[front]);
+          position[elements[position[from]]] = position[from];
+          position[from] = front;
+          if (marked[blk]++ == 0) {
+            touched.push_back(blk);
+          }
+        }
+      }
+
+      for (size_t blk : touched) {
+        size_t split = begin[blk] + marked[blk];
+        marked[blk] = 0;
+        if (split == end[blk]) {
+          continue;
+        }
+
+        size_t new_block = begin.size();
+        if (split - begin[blk] <= end[blk] - split) {
+          begin.push_back(begin[blk]);
+          end.push_back(split);
+          begin[blk] = split;
+        } else {
+          begin.push_back(split);
+          end.push_back(end[blk]);
+          end[blk] = split;
+        }
+        marked.push_back(0);
+        for (size_t i = begin[new_block]; i < end[new_block]; ++i) {
+          block[elements[i]] = new_block;
+        }
+        // Either `blk` is still queued or `new_block` is the smaller half.
+        worklist.push_back(new_block);
+        in_worklist.push_back(true);
+      }
+    }
+  }
+
+  // Like NaiveMinimize, the classes of the first non-accepting and the first
+  // accepting state come first; the rest are ordered by their smallest state.
+  std::vector<std::pair<size_t, size_t>> order(begin.size(), {2, sink});
+  for (size_t blk = 0; blk < order.size(); ++blk) {
+    for (size_t i = begin[blk]; i < end[blk]; ++i) {
+      order[blk].second = std::min(order[blk].second, elements[i]);
+    }
+  }
+  for (bool finite : {false, true}) {
+    for (size_t node = 0; node < size; ++node) {
+      if (is_finite(node) == finite) {
+        order[block[node]].first = finite;
+        break;
+      }
+    }
+  }
+  std::vector<size_t> by_order(order.size());
+  for (size_t blk = 0; blk < by_order.size(); ++blk) {
+    by_order[blk] = blk;
+  }
+  std::sort(by_order.begin(), by_order.end(),
+            [&](size_t lhs, size_t rhs) { return order[lhs] < order[rhs]; });
+
+  bool drop_sink = has_sink && end[block[sink]] - begin[block[sink]] == 1;
+  const size_t kNoClass = std::numeric_limits<size_t>::max();
+  std::vector<size_t> class_id(begin.size(), kNoClass);
+  size_t next_id = 0;
+  for (size_t blk : by_order) {
+    if (!(drop_sink && blk == block[sink])) {
+      class_id[blk] = next_id++;
+    }
+  }
+
+  FDFA<Alphabet, Node> mindfa;
+  for (size_t i = 1; i < next_id; ++i) {
+    mindfa.CreateNode();
+  }
+  for (size_t blk = 0; blk < begin.size(); ++blk) {
+    if (class_id[blk] == kNoClass) {
+      continue;
+    }
+    size_t rep = elements[begin[blk]];
+    for (uint64_t via = 1; via < Alphabet::kSize; ++via) {
+      mindfa.SetTransition(class_id[blk], via,
+                           class_id[block[target(rep, via)]]);
+    }
+    if (is_finite(rep)) {
+      mindfa.MakeFinite(class_id[blk]);
+    }
+  }
+  mindfa.SetStart(class_id[block[fdfa.Start()]]);
+  return mindfa;
+}
+}  // namespace details
+
+enum class MinimizeAlgorithm {
+  Hopcroft,
+  Naive,  // Quadratic class splitting, kept to cross-check Hopcroft.
+};
+
+template <typename Alphabet, typename Node>
+FDFA<Alphabet, Node> Minimize(
+    const FDFA<Alphabet, Node>& fdfa,
+    MinimizeAlgorithm algorithm = MinimizeAlgorithm::Hopcroft) {
+  if (algorithm == MinimizeAlgorithm::Naive) {
+    return details::NaiveMinimize(fdfa);
+  }
+  return details::HopcroftMinimize(fdfa);
+}
+
+template <typename Alphabet, typename Node>
+Regex<Alphabet> RegexFromFDFA(const FDFA<Alphabet, Node>& dfa) {
   using Regex = Regex<Alphabet>;
   std::vector<Regex> rgx_alphabet = {};
   rgx_alphabet.emplace_back(Regex::EmptyString());
@@ -191,14 +713,16 @@ Regex<Alphabet> RegexFromFDFA(const FDFA<Alphabet>& dfa) {
     rgx_alphabet.emplace_back(Regex::SingeLetter(Alphabet::Chr(i)));
   }
 
-  auto regex_num = [&rgx_alphabet](const Regex& regex) -> uint64_t {
-    for (size_t i = 0; i < rgx_alphabet.size(); ++i) {
-      if (rgx_alphabet[i] == regex) {
-        return i;
-      }
+  std::unordered_map<Regex, uint64_t> regex_ids;
+  for (size_t i = 0; i < rgx_alphabet.size(); ++i) {
+    regex_ids.emplace(rgx_alphabet[i], i);
+  }
+  auto regex_num = [&rgx_alphabet, &regex_ids](const Regex& regex) {
+    auto [it, added] = regex_ids.emplace(regex, rgx_alphabet.size());
+    if (added) {
+      rgx_alphabet.emplace_back(regex);
     }
-    rgx_alphabet.emplace_back(regex);
-    return rgx_alphabet.size() - 1;
+    return it->second;
   };
 
   NFSA<AnyAlphabet> regex_nfa{};
@@ -209,7 +733,11 @@ Regex<Alphabet> RegexFromFDFA(const FDFA<Alphabet>& dfa) {
 
   for (size_t from = 0; from < dfa.Size(); ++from) {
     for (uint64_t via = 1; via < dfa.Transitions(from).size(); ++via) {
-      regex_nfa.AddTransition(from, via, dfa.Transitions(from)[via]);
+      Node to = dfa.Transitions(from)[via];
+      // Partial DFAs leave missing edges at kErrorState, which is no state.
+      if (to != FDFA<Alphabet, Node>::kErrorState) {
+        regex_nfa.AddTransition(from, via, to);
+      }
     }
   }
 
@@ -222,7 +750,13 @@ Regex<Alphabet> RegexFromFDFA(const FDFA<Alphabet>& dfa) {
     }
   }
 
-  regex_nfa.OptimizeUnreachableTerm();
+  // Trimming keeps the order of states, so `term` stays the last one unless
+  // no accepting state is reachable.
+  regex_nfa.Trim();
+  if (regex_nfa.Size() == 1 && !regex_nfa.IsFinite(regex_nfa.Start())) {
+    return Regex();
+  }
+  term = regex_nfa.Size() - 1;
 
   std::vector<std::vector<std::pair<uint64_t, uint64_t>>> reverse_transitions(
       regex_nfa.Size());
@@ -315,16 +849,26 @@ Regex<Alphabet> RegexFromFDFA(const FDFA<Alphabet>& dfa) {
   return std::move(final_regex);
 }
 
-template <typename Alphabet>
-FDFA<Alphabet> MDFAFromRegex(Regex<Alphabet> rgx) {
-  return Minimize(FDFAFromNFA(NFAFromRegex(rgx).RemoveEpsilonTransitions()));
+// `Node` is the id type of the minimized DFA only; construction runs on
+// std::size_t ids since the unminimized DFA may be much larger. Throws
+// std::length_error if the minimized DFA doesn't fit in `Node`.
+template <typename Alphabet, typename Node = std::size_t>
+FDFA<Alphabet, Node> MDFAFromRegex(const Regex<Alphabet>& rgx) {
+  auto mdfa = Minimize(FDFAFromNFA(GlushkovNFAFromRegex<Alphabet>(rgx)));
+  if constexpr (std::is_same_v<Node, std::size_t>) {
+    return mdfa;
+  } else {
+    return ConvertNodes<Node>(mdfa);
+  }
 }
 
+// One-off match of a pattern in reverse Polish notation: its Glushkov
+// automaton has no epsilon edges, so it is matched as built. Malformed
+// patterns match nothing. Keep a CompiledPattern to match many strings.
 template <typename Alphabet>
-size_t MaxRegexMatch(std::string regex, std::string_view str) {
-  return rgx::NFAFromRegex(
-             rgx::Regex<Alphabet>::FromReversePolishNotation(regex))
-      .RemoveEpsilonTransitions()
+size_t MaxRegexMatch(std::string_view regex, std::string_view str) {
+  return GlushkovNFAFromRegex(
+             Regex<Alphabet>::FromReversePolishNotation(regex))
       .MaxMatch(str);
 }
 